@@ -0,0 +1,418 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "analysis.h"
+#include "scheduler.h"
+#include "memstats.h"
+
+using namespace SF2;
+
+static const int numLengthClasses = 4;
+
+//---------------------------------------------------------
+//   LoadTask
+//---------------------------------------------------------
+
+class CodecAnalysis::LoadTask : public Task
+{
+public:
+    LoadTask (CodecAnalysis& a, int i) : analysis(a), index(i) {}
+    
+    int64 getCost() const override
+    {
+        return analysis.getRawBytes(index);
+    }
+    
+    void run (Scheduler&) override
+    {
+        analysis.font.loadSample(index);
+    }
+
+private:
+    CodecAnalysis& analysis;
+    const int index;
+};
+
+//---------------------------------------------------------
+//   EncodeTask
+//---------------------------------------------------------
+
+class CodecAnalysis::EncodeTask : public Task
+{
+public:
+    EncodeTask (CodecAnalysis& a, int s, int p) : analysis(a), setting(s), position(p) {}
+    
+    int64 getCost() const override
+    {
+        return analysis.font.getSample(analysis.subset[position])->numSamples() * (int64)sizeof(short);
+    }
+    
+    void run (Scheduler&) override
+    {
+        analysis.measure(setting, position);
+    }
+
+private:
+    CodecAnalysis& analysis;
+    const int setting;
+    const int position;
+};
+
+//---------------------------------------------------------
+//   CodecAnalysis
+//---------------------------------------------------------
+
+CodecAnalysis::CodecAnalysis (SoundFont& f, int maxSamples) :
+    font(f),
+    seconds(0)
+{
+    stratify(maxSamples);
+    
+    // Every option the codecs offer, marking those the -z flags select
+    const FileType formats[] = { SF3Format, SF4Format };
+    const char* flags[] = { "-zo", "-zf" };
+    
+    for (int f = 0; f < 2; f++)
+    {
+        const StringArray options = font.getEncoderOptions(formats[f]);
+        for (int o = 0; o < options.size(); o++)
+        {
+            Setting setting;
+            setting.format = formats[f];
+            setting.option = o;
+            setting.name = (formats[f] == SF3Format ? "Vorbis " : "FLAC ") + options[o];
+            
+            for (int quality = 0; quality <= 2; quality++)
+                if (font.getEncoderOption(formats[f], quality) == o)
+                    setting.flag = flags[f] + String(quality);
+            
+            settings.add(setting);
+        }
+    }
+}
+
+CodecAnalysis::~CodecAnalysis()
+{
+}
+
+/** Lengths are only known for sure once decoded. Until then, compressed
+    banks without verification data are weighed by their compressed size,
+    which is good enough to scale results within a stratum. */
+int64 CodecAnalysis::getRawBytes (int index) const
+{
+    const Sample* s = font.getSample(index);
+    if (s->isLoaded())
+        return s->numSamples() * (int64)sizeof(short);
+    if (s->meta != nullptr)
+        return s->meta->samples * (int64)sizeof(short);
+    if (font._fileFormatIn == SF2Format)
+        return (s->end - s->start) * (int64)sizeof(short);
+    return s->end - s->start;
+}
+
+/** Below 8K, 64K and 512K bytes, and above */
+int CodecAnalysis::getLengthClass (int64 rawBytes)
+{
+    int lengthClass = 0;
+    for (int64 limit = 8192; rawBytes >= limit && lengthClass < numLengthClasses - 1; limit *= 8)
+        lengthClass++;
+    return lengthClass;
+}
+
+void CodecAnalysis::stratify (int maxSamples)
+{
+    for (int i = 0; i < numLengthClasses * 2; i++)
+    {
+        Stratum* stratum = new Stratum;
+        stratum->rawBytes = 0;
+        stratum->subsetRawBytes = 0;
+        strata.add(stratum);
+    }
+    
+    int64 total = 0;
+    for (int i = 0; i < font.getNumSamples(); i++)
+    {
+        const Sample* s = font.getSample(i);
+        const bool stereo = (s->sampletype & (SampleType::Left | SampleType::Right | SampleType::Linked)) != 0;
+        const int64 raw = getRawBytes(i);
+        
+        Stratum* stratum = strata.getUnchecked(getLengthClass(raw) * 2 + (stereo ? 1 : 0));
+        stratum->samples.add(i);
+        stratum->rawBytes += raw;
+        total += raw;
+    }
+    
+    int numUsed = 0;
+    for (int i = 0; i < strata.size(); i++)
+        if (strata.getUnchecked(i)->samples.size() > 0)
+            numUsed++;
+    
+    // At least one sample per stratum, the rest by share of sample data,
+    // evenly spaced so that the same bank always gives the same subset
+    const int budget = jmax(maxSamples, numUsed);
+    
+    for (int i = 0; i < strata.size(); i++)
+    {
+        Stratum* stratum = strata.getUnchecked(i);
+        const int available = stratum->samples.size();
+        if (available == 0)
+            continue;
+        
+        const double share = total > 0 ? (double)stratum->rawBytes / (double)total : 0.0;
+        const int n = jlimit(1, available, roundToInt(budget * share));
+        
+        for (int k = 0; k < n; k++)
+        {
+            const int index = stratum->samples[(int)((k + 0.5) * available / n)];
+            stratum->subset.add(index);
+            stratum->subsetRawBytes += getRawBytes(index);
+            subset.add(index);
+            subsetStratum.add(i);
+        }
+    }
+}
+
+//---------------------------------------------------------
+//   run
+//---------------------------------------------------------
+
+bool CodecAnalysis::run (int numThreads)
+{
+    const double started = Time::getMillisecondCounterHiRes();
+    Scheduler scheduler (numThreads);
+    
+    for (int i = 0; i < subset.size(); i++)
+        scheduler.add(new LoadTask(*this, subset[i]));
+    scheduler.waitUntilIdle();
+    
+    for (int i = 0; i < subset.size(); i++)
+        if (!font.getSample(subset[i])->isLoaded())
+            return false;
+    
+    Measurement none;
+    zerostruct(none);
+    measurements.clearQuick();
+    measurements.insertMultiple(0, none, settings.size() * subset.size());
+    
+    for (int s = 0; s < settings.size(); s++)
+        for (int p = 0; p < subset.size(); p++)
+            scheduler.add(new EncodeTask(*this, s, p));
+    scheduler.waitUntilIdle();
+    
+    seconds = (Time::getMillisecondCounterHiRes() - started) / 1000.0;
+    return true;
+}
+
+/** Encodes and decodes one sample with one setting. Each task writes
+    its own measurement, which was allocated up front. */
+void CodecAnalysis::measure (int setting, int position)
+{
+    const Setting& set = settings.getReference(setting);
+    const Sample* s = font.getSample(subset[position]);
+    Measurement& m = measurements.getReference(setting * subset.size() + position);
+    
+    MemoryBlock payload;
+    double started = Time::getMillisecondCounterHiRes();
+    if (set.format == SF3Format)
+        font.encodeSampleDataVorbis(s, set.option, payload);
+    else
+        font.encodeSampleDataFlac(s, set.option, payload);
+    m.encodeSeconds = (Time::getMillisecondCounterHiRes() - started) / 1000.0;
+    m.bytes = payload.getSize();
+    
+    if (m.bytes == 0)
+        return;
+    
+    ScopedMemoryUse compressed (MemoryStats::Compressed, m.bytes);
+    Sample decoded;
+    decoded.allocateByteData((int)m.bytes);
+    memcpy(decoded.byteData, payload.getData(), (size_t)m.bytes);
+    
+    started = Time::getMillisecondCounterHiRes();
+    try {
+        font.decodeByteData(&decoded, set.format);
+    }
+    catch (juce::String e) {
+        font.error(e);
+        return;
+    }
+    catch (const char* e) {
+        font.error(String(e));
+        return;
+    }
+    m.decodeSeconds = (Time::getMillisecondCounterHiRes() - started) / 1000.0;
+    
+    m.snr = getSnr(s, &decoded);
+    m.lossless = decoded.numSamples() == s->numSamples()
+              && memcmp(decoded.sampleData, s->sampleData, s->numSamples() * sizeof(short)) == 0;
+    m.ok = true;
+}
+
+/** Signal to noise ratio in dB, capped at 144 dB (16 bit) for identical data */
+double CodecAnalysis::getSnr (const Sample* original, const Sample* decoded)
+{
+    const int n = jmin(original->numSamples(), decoded->numSamples());
+    double signal = 0, noise = 0;
+    
+    for (int i = 0; i < n; i++)
+    {
+        const double a = original->sampleData[i];
+        const double e = a - decoded->sampleData[i];
+        signal += a * a;
+        noise += e * e;
+    }
+    
+    if (noise <= 0)
+        return 144.0;
+    if (signal <= 0)
+        return 0.0;
+    return jmin(144.0, 10.0 * std::log10(signal / noise));
+}
+
+//---------------------------------------------------------
+//   project
+//---------------------------------------------------------
+
+/** Scales each stratum's measurements by its share of the whole bank */
+CodecAnalysis::Projection CodecAnalysis::project (int setting) const
+{
+    Projection p;
+    p.encodeSeconds = 0;
+    p.decodeSeconds = 0;
+    p.minSnr = 144.0;
+    p.meanSnr = 0;
+    p.lossless = true;
+    p.ok = true;
+    
+    // Headers stay as they are, plus verification data when compressing SF2
+    double bytes = jmax((int64)0, font._fileSizeIn - font._sampleLen);
+    if (font._fileFormatIn == SF2Format)
+        bytes += 8 + (font.getNumSamples() + 1) * SampleMetaSize;
+    
+    int measured = 0;
+    for (int i = 0; i < subset.size(); i++)
+    {
+        const Measurement& m = measurements.getReference(setting * subset.size() + i);
+        if (!m.ok)
+        {
+            p.ok = false;
+            continue;
+        }
+        
+        const Stratum* stratum = strata.getUnchecked(subsetStratum[i]);
+        const double scale = stratum->subsetRawBytes > 0 ? (double)stratum->rawBytes / (double)stratum->subsetRawBytes : 0.0;
+        bytes           += m.bytes * scale;
+        p.encodeSeconds += m.encodeSeconds * scale;
+        p.decodeSeconds += m.decodeSeconds * scale;
+        p.minSnr         = jmin(p.minSnr, m.snr);
+        p.meanSnr       += m.snr;
+        p.lossless       = p.lossless && m.lossless;
+        measured++;
+    }
+    
+    p.fileBytes = (int64)bytes;
+    p.meanSnr = measured > 0 ? p.meanSnr / measured : 0.0;
+    return p;
+}
+
+//---------------------------------------------------------
+//   Results
+//---------------------------------------------------------
+
+void CodecAnalysis::printMatrix() const
+{
+    int64 subsetBytes = 0, totalBytes = 0;
+    for (int i = 0; i < strata.size(); i++)
+    {
+        subsetBytes += strata.getUnchecked(i)->subsetRawBytes;
+        totalBytes  += strata.getUnchecked(i)->rawBytes;
+    }
+    
+    fprintf(stderr, "\nAnalyzed %d of %d samples (%.1f%% of sample data) in %.1f s\n",
+            subset.size(), font.getNumSamples(),
+            totalBytes > 0 ? 100.0 * subsetBytes / totalBytes : 0.0, seconds);
+    fprintf(stderr, "Projected for the whole bank, input %.1f MB. Times are CPU seconds on one core.\n\n",
+            font._fileSizeIn / 1048576.0);
+    
+    fprintf(stderr, "%-22s %-5s %9s %7s %9s %9s %9s %9s\n",
+            "Setting", "Flag", "Size MB", "Ratio", "Encode s", "Decode s", "Min SNR", "Mean SNR");
+    
+    for (int s = 0; s < settings.size(); s++)
+    {
+        const Setting& set = settings.getReference(s);
+        const Projection p = project(s);
+        
+        String snr;
+        if (!p.ok)
+            snr = "   FAILED";
+        else if (set.format == SF4Format)
+            snr = p.lossless ? "           lossless" : "           MISMATCH";
+        else
+            snr = String::formatted("%9.1f %9.1f", p.minSnr, p.meanSnr);
+        
+        fprintf(stderr, "%-22s %-5s %9.1f %6.0f%% %9.2f %9.2f %s\n",
+                set.name.toRawUTF8(), set.flag.toRawUTF8(), p.fileBytes / 1048576.0,
+                font._fileSizeIn > 0 ? 100.0 * p.fileBytes / font._fileSizeIn : 0.0,
+                p.encodeSeconds, p.decodeSeconds, snr.toRawUTF8());
+    }
+}
+
+var CodecAnalysis::getResults() const
+{
+    Array<var> list;
+    for (int s = 0; s < settings.size(); s++)
+    {
+        const Setting& set = settings.getReference(s);
+        const Projection p = project(s);
+        
+        DynamicObject::Ptr setting = new DynamicObject();
+        setting->setProperty("codec", set.name);
+        setting->setProperty("format", set.format == SF3Format ? "sf3" : "sf4");
+        setting->setProperty("option", set.option);
+        setting->setProperty("flag", set.flag);
+        setting->setProperty("ok", p.ok);
+        setting->setProperty("projectedSize", p.fileBytes);
+        setting->setProperty("encodeSeconds", p.encodeSeconds);
+        setting->setProperty("decodeSeconds", p.decodeSeconds);
+        if (set.format == SF3Format)
+        {
+            setting->setProperty("minSnr", p.minSnr);
+            setting->setProperty("meanSnr", p.meanSnr);
+        }
+        else
+            setting->setProperty("lossless", p.lossless);
+        list.add(setting.get());
+    }
+    
+    DynamicObject::Ptr results = new DynamicObject();
+    results->setProperty("tool", ProjectInfo::projectName);
+    results->setProperty("version", ProjectInfo::versionString);
+    results->setProperty("input", font._path.getFullPathName());
+    results->setProperty("size", font._fileSizeIn);
+    results->setProperty("samples", font.getNumSamples());
+    results->setProperty("subset", subset.size());
+    results->setProperty("seconds", seconds);
+    results->setProperty("settings", list);
+    return results.get();
+}
@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANALYSIS_H__
+#define __ANALYSIS_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "sfont.h"
+
+namespace SF2 {
+
+class Scheduler;
+
+//---------------------------------------------------------
+//   CodecAnalysis
+//---------------------------------------------------------
+
+/** Estimates size, speed and fidelity of every Vorbis and FLAC encoder
+    option for a bank, from a small subset of its samples. The subset is
+    stratified by sample length and mono/stereo, and each stratum's results
+    are scaled by its share of the whole bank. Times are CPU seconds as if
+    the whole bank was converted on a single core. */
+
+class CodecAnalysis
+{
+public:
+    /** The font must have its headers read */
+    CodecAnalysis (SoundFont& font, int maxSamples = 32);
+   ~CodecAnalysis();
+    
+    /** Loads the subset and encodes & decodes it with every option, in parallel */
+    bool run (int numThreads = 0);
+    
+    void printMatrix() const;
+    var getResults() const;
+    
+    int getNumSubsetSamples() const     { return subset.size(); }
+    
+    /** Signal to noise ratio in dB, capped at 144 dB (16 bit) for identical data */
+    static double getSnr (const Sample* original, const Sample* decoded);
+
+private:
+    class LoadTask;
+    class EncodeTask;
+    
+    /** Samples of similar length and the same channel type */
+    struct Stratum
+    {
+        int64 rawBytes;         // of all samples in the bank
+        int64 subsetRawBytes;   // of those analyzed
+        Array<int> samples;
+        Array<int> subset;
+    };
+    
+    struct Setting
+    {
+        FileType format;
+        int option;
+        String name;
+        String flag;            // command line flag selecting it, if any
+    };
+    
+    struct Measurement
+    {
+        bool ok;
+        int64 bytes;
+        double encodeSeconds;
+        double decodeSeconds;
+        double snr;
+        bool lossless;
+    };
+    
+    struct Projection
+    {
+        int64 fileBytes;
+        double encodeSeconds;
+        double decodeSeconds;
+        double minSnr;
+        double meanSnr;
+        bool lossless;
+        bool ok;
+    };
+    
+    void stratify (int maxSamples);
+    int64 getRawBytes (int sampleIndex) const;
+    void measure (int setting, int position);
+    Projection project (int setting) const;
+    
+    static int getLengthClass (int64 rawBytes);
+    
+    SoundFont& font;
+    OwnedArray<Stratum> strata;
+    Array<int> subset;          // sample indices
+    Array<int> subsetStratum;   // stratum of each subset entry
+    Array<Setting> settings;
+    Array<Measurement> measurements; // per setting and subset entry
+    double seconds;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CodecAnalysis);
+};
+    
+} // namespace
+
+#endif
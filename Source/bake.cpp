@@ -0,0 +1,545 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bake.h"
+
+using namespace SF2;
+
+//---------------------------------------------------------
+//   Generators
+//---------------------------------------------------------
+
+/** Generator values of one zone, or of a zone and its global zone */
+struct ZoneValues
+{
+    int gens[Gen_Dummy];
+    int keyLo, keyHi;
+    int velLo, velHi;
+};
+
+/** Defaults as in section 8.1.3 of the SF2 spec */
+static void setDefaults (ZoneValues& v)
+{
+    for (int i = 0; i < Gen_Dummy; i++)
+        v.gens[i] = 0;
+    
+    const Generator timecents[] = {
+        Gen_ModLFODelay, Gen_VibLFODelay,
+        Gen_ModEnvDelay, Gen_ModEnvAttack, Gen_ModEnvHold, Gen_ModEnvDecay, Gen_ModEnvRelease,
+        Gen_VolEnvDelay, Gen_VolEnvAttack, Gen_VolEnvHold, Gen_VolEnvDecay, Gen_VolEnvRelease
+    };
+    for (int i = 0; i < numElementsInArray(timecents); i++)
+        v.gens[timecents[i]] = -12000;
+    
+    v.gens[Gen_FilterFc] = 13500;
+    v.gens[Gen_ScaleTune] = 100;
+    v.gens[Gen_Keynum] = -1;
+    v.gens[Gen_Velocity] = -1;
+    v.gens[Gen_OverrideRootKey] = -1;
+    v.keyLo = v.velLo = 0;
+    v.keyHi = v.velHi = 127;
+}
+
+static void setOffsets (ZoneValues& v)
+{
+    for (int i = 0; i < Gen_Dummy; i++)
+        v.gens[i] = 0;
+    
+    v.keyLo = v.velLo = 0;
+    v.keyHi = v.velHi = 127;
+}
+
+/** Values of a zone replace those of its global zone */
+static void apply (const Zone* zone, ZoneValues& v)
+{
+    if (zone == nullptr)
+        return;
+    
+    for (int i = 0; i < zone->generators.size(); i++)
+    {
+        const GeneratorList* g = zone->generators.getUnchecked(i);
+        if (g->gen == Gen_KeyRange)
+        {
+            v.keyLo = g->amount.lo;
+            v.keyHi = g->amount.hi;
+        }
+        else if (g->gen == Gen_VelRange)
+        {
+            v.velLo = g->amount.lo;
+            v.velHi = g->amount.hi;
+        }
+        else if (g->gen >= 0 && g->gen < Gen_Dummy)
+            v.gens[g->gen] = g->amount.sword;
+    }
+}
+
+/** Preset zones may only offset these, see section 8.5 of the SF2 spec */
+static bool isPresetGenerator (int gen)
+{
+    switch (gen)
+    {
+        case Gen_StartAddrOfs:
+        case Gen_EndAddrOfs:
+        case Gen_StartLoopAddrOfs:
+        case Gen_EndLoopAddrOfs:
+        case Gen_StartAddrCoarseOfs:
+        case Gen_EndAddrCoarseOfs:
+        case Gen_StartLoopAddrCoarseOfs:
+        case Gen_EndLoopAddrCoarseOfs:
+        case Gen_Keynum:
+        case Gen_Velocity:
+        case Gen_SampleModes:
+        case Gen_ExclusiveClass:
+        case Gen_OverrideRootKey:
+        case Gen_Instrument:
+        case Gen_SampleId:
+        case Gen_KeyRange:
+        case Gen_VelRange:
+        case Gen_Unused1: case Gen_Unused2: case Gen_Unused3: case Gen_Unused4:
+        case Gen_Reserved1: case Gen_Reserved2: case Gen_Reserved3:
+            return false;
+        default:
+            return true;
+    }
+}
+
+/** Value of a zone's generator, or -1 if it has none */
+static int findGenerator (const Zone* zone, Generator gen)
+{
+    for (int i = 0; i < zone->generators.size(); i++)
+        if (zone->generators.getUnchecked(i)->gen == gen)
+            return zone->generators.getUnchecked(i)->amount.uword;
+    return -1;
+}
+
+static void copyName (char* dest, size_t size, const String& name)
+{
+    zeromem(dest, size);
+    const char* utf8 = name.toRawUTF8();
+    memcpy(dest, utf8, jmin(size - 1, strlen(utf8)));
+}
+
+static uint64 align (uint64 offset, uint64 alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static void padTo (OutputStream& out, uint64 offset)
+{
+    jassert ((uint64)out.getPosition() <= offset);
+    out.writeRepeatedByte(0, (size_t)(offset - out.getPosition()));
+}
+
+//---------------------------------------------------------
+//   BakedWriter
+//---------------------------------------------------------
+
+BakedWriter::BakedWriter (SoundFont& font) :
+    _font(font)
+{
+    zerostruct(_header);
+}
+
+BakedWriter::~BakedWriter()
+{
+}
+
+//---------------------------------------------------------
+//   write
+//---------------------------------------------------------
+
+bool BakedWriter::write (const File& file)
+{
+    for (int i = 0; i < _font.getNumSamples(); i++)
+    {
+        if (!_font.loadSample(i))
+        {
+            _lastError = _font.getLastError();
+            return false;
+        }
+    }
+    
+    resolve();
+    
+    TemporaryFile temp (file, TemporaryFile::useHiddenFile);
+    {
+        FileOutputStream out (temp.getFile());
+        if (out.failedToOpen())
+        {
+            _lastError = "cannot open " + temp.getFile().getFullPathName();
+            return false;
+        }
+        
+        writeTables(out);
+        
+        for (int i = 0; i < _samples.size(); i++)
+        {
+            const Sample* s = _font.getSample(i);
+            padTo(out, _samples.getReference(i).pcm);
+            out.write(s->sampleData, s->numSamples() * sizeof(short));
+            out.writeRepeatedByte(0, BakedGuardFrames * sizeof(short));
+        }
+        
+        out.flush();
+        if (out.getStatus().failed() || (uint64)out.getPosition() != _header.fileSize)
+        {
+            _lastError = "cannot write " + temp.getFile().getFullPathName();
+            return false;
+        }
+    }
+    
+    if (!temp.overwriteTargetFileWithTemporary())
+    {
+        _lastError = "cannot replace " + file.getFullPathName();
+        return false;
+    }
+    return true;
+}
+
+//---------------------------------------------------------
+//   resolve
+//---------------------------------------------------------
+
+void BakedWriter::resolve()
+{
+    _presets.clearQuick();
+    _regions.clearQuick();
+    _refs.clearQuick();
+    _samples.clearQuick();
+    
+    const Array<int> order = _font.getPresetsByNumber();
+    
+    for (int i = 0; i < order.size(); i++)
+    {
+        BakedPreset baked;
+        zerostruct(baked);
+        resolvePreset(_font.getPreset(order[i]), baked);
+        _presets.add(baked);
+    }
+    
+    for (int i = 0; i < _font.getNumSamples(); i++)
+    {
+        const Sample* s = _font.getSample(i);
+        BakedSample baked;
+        zerostruct(baked);
+        copyName(baked.name, sizeof(baked.name), s->name);
+        baked.frames = (uint32)s->numSamples();
+        baked.loopStart = s->loopstart;
+        baked.loopEnd = s->loopend;
+        baked.sampleRate = s->samplerate;
+        baked.originalPitch = (int16)s->origpitch;
+        baked.pitchCorrection = (int16)s->pitchadj;
+        baked.type = (uint16)(s->sampletype & ~(TypeVorbis | TypeFlac));
+        baked.link = s->sampleLink;
+        _samples.add(baked);
+    }
+}
+
+void BakedWriter::resolvePreset (const Preset* preset, BakedPreset& baked)
+{
+    copyName(baked.name, sizeof(baked.name), preset->name);
+    baked.bank = (uint16)preset->bank;
+    baked.program = (uint16)preset->preset;
+    baked.firstRegion = (uint32)_regions.size();
+    
+    // A first zone without an instrument is the global zone
+    const Zone* presetGlobal = nullptr;
+    for (int z = 0; z < preset->zones.size(); z++)
+    {
+        const Zone* presetZone = preset->zones.getUnchecked(z);
+        const int index = findGenerator(presetZone, Gen_Instrument);
+        if (index < 0)
+        {
+            if (z == 0)
+                presetGlobal = presetZone;
+            continue;
+        }
+        
+        const Instrument* instrument = _font.getInstrument(index);
+        if (instrument == nullptr)
+            continue;
+        
+        const Zone* instGlobal = nullptr;
+        for (int i = 0; i < instrument->zones.size(); i++)
+        {
+            const Zone* instZone = instrument->zones.getUnchecked(i);
+            if (findGenerator(instZone, Gen_SampleId) >= 0)
+                resolveZone(presetGlobal, presetZone, instGlobal, instZone);
+            else if (i == 0)
+                instGlobal = instZone;
+        }
+    }
+    
+    baked.numRegions = (uint32)_regions.size() - baked.firstRegion;
+    
+    // Regions per key, in the order of the file
+    for (int key = 0; key < 128; key++)
+    {
+        baked.keys[key] = (uint32)_refs.size();
+        for (uint32 r = baked.firstRegion; r < baked.firstRegion + baked.numRegions; r++)
+        {
+            const BakedRegion& region = _regions.getReference(r);
+            if (key >= region.keyLo && key <= region.keyHi)
+                _refs.add(r);
+        }
+    }
+    baked.keys[128] = (uint32)_refs.size();
+}
+
+void BakedWriter::resolveZone (const Zone* presetGlobal, const Zone* presetZone,
+                               const Zone* instGlobal, const Zone* instZone)
+{
+    const int sampleIndex = findGenerator(instZone, Gen_SampleId);
+    const Sample* s = _font.getSample(sampleIndex);
+    if (s == nullptr)
+        return;
+    
+    ZoneValues values;
+    setDefaults(values);
+    apply(instGlobal, values);
+    apply(instZone, values);
+    
+    ZoneValues offsets;
+    setOffsets(offsets);
+    apply(presetGlobal, offsets);
+    apply(presetZone, offsets);
+    
+    // Ranges of preset & instrument both apply
+    BakedRegion region;
+    zerostruct(region);
+    const int keyLo = jmax(values.keyLo, offsets.keyLo);
+    const int keyHi = jmin(values.keyHi, offsets.keyHi, 127);
+    const int velLo = jmax(values.velLo, offsets.velLo);
+    const int velHi = jmin(values.velHi, offsets.velHi, 127);
+    if (keyLo > keyHi || velLo > velHi)
+        return;
+    
+    region.keyLo = (uint8)keyLo;
+    region.keyHi = (uint8)keyHi;
+    region.velLo = (uint8)velLo;
+    region.velHi = (uint8)velHi;
+    
+    for (int i = 0; i < Gen_Dummy; i++)
+        if (isPresetGenerator(i))
+            values.gens[i] += offsets.gens[i];
+    
+    const int* g = values.gens;
+    const int frames = s->numSamples();
+    const int start     = jlimit(0, frames, g[Gen_StartAddrOfs] + 32768 * g[Gen_StartAddrCoarseOfs]);
+    const int end       = jlimit(start, frames, frames + g[Gen_EndAddrOfs] + 32768 * g[Gen_EndAddrCoarseOfs]);
+    const int loopStart = jlimit(start, end, (int)s->loopstart + g[Gen_StartLoopAddrOfs] + 32768 * g[Gen_StartLoopAddrCoarseOfs]);
+    const int loopEnd   = jlimit(loopStart, end, (int)s->loopend + g[Gen_EndLoopAddrOfs] + 32768 * g[Gen_EndLoopAddrCoarseOfs]);
+    
+    region.sample = (uint32)sampleIndex;
+    region.start = (uint32)start;
+    region.end = (uint32)end;
+    region.loopStart = (uint32)loopStart;
+    region.loopEnd = (uint32)loopEnd;
+    
+    values.gens[Gen_SampleId] = sampleIndex;
+    if (values.gens[Gen_OverrideRootKey] < 0)
+        values.gens[Gen_OverrideRootKey] = s->origpitch;
+    
+    for (int i = 0; i < Gen_Dummy; i++)
+        region.gens[i] = (int16)jlimit(-32768, 32767, values.gens[i]);
+    
+    _regions.add(region);
+}
+
+//---------------------------------------------------------
+//   writeTables
+//---------------------------------------------------------
+
+void BakedWriter::writeTables (OutputStream& out)
+{
+    BakedHeader& h = _header;
+    zerostruct(h);
+    memcpy(h.magic, BakedMagic, sizeof(h.magic));
+    h.version = BakedVersion;
+    h.byteOrder = BakedByteOrder;
+    h.headerSize = sizeof(BakedHeader);
+    h.numPresets = (uint32)_presets.size();
+    h.numRegions = (uint32)_regions.size();
+    h.numRefs = (uint32)_refs.size();
+    h.numSamples = (uint32)_samples.size();
+    copyName(h.name, sizeof(h.name), _font.getName());
+    
+    h.presets = align(sizeof(BakedHeader), 8);
+    h.regions = align(h.presets + h.numPresets * sizeof(BakedPreset), 8);
+    h.refs    = align(h.regions + h.numRegions * sizeof(BakedRegion), 8);
+    h.samples = align(h.refs + h.numRefs * sizeof(uint32), 8);
+    
+    uint64 pos = h.samples + h.numSamples * sizeof(BakedSample);
+    for (int i = 0; i < _samples.size(); i++)
+    {
+        BakedSample& s = _samples.getReference(i);
+        s.pcm = align(pos, BakedPageSize);
+        pos = s.pcm + (s.frames + BakedGuardFrames) * sizeof(short);
+    }
+    h.fileSize = pos;
+    
+    out.write(&h, sizeof(h));
+    padTo(out, h.presets);
+    out.write(_presets.getRawDataPointer(), _presets.size() * sizeof(BakedPreset));
+    padTo(out, h.regions);
+    out.write(_regions.getRawDataPointer(), _regions.size() * sizeof(BakedRegion));
+    padTo(out, h.refs);
+    out.write(_refs.getRawDataPointer(), _refs.size() * sizeof(uint32));
+    padTo(out, h.samples);
+    out.write(_samples.getRawDataPointer(), _samples.size() * sizeof(BakedSample));
+}
+
+//---------------------------------------------------------
+//   BakedFont
+//---------------------------------------------------------
+
+BakedFont::BakedFont (const File& file) :
+    _data(nullptr),
+    _header(nullptr)
+{
+    _map = new MemoryMappedFile(file, MemoryMappedFile::readOnly);
+    _data = (const char*)_map->getData();
+    
+    if (_data == nullptr)
+        _lastError = "cannot map " + file.getFullPathName();
+    else if (check())
+        _header = (const BakedHeader*)_data;
+}
+
+BakedFont::~BakedFont()
+{
+}
+
+/** Only what is needed to use the tables safely, nothing per entry */
+bool BakedFont::check()
+{
+    const size_t size = _map->getSize();
+    const BakedHeader* h = (const BakedHeader*)_data;
+    
+    if (size < sizeof(BakedHeader) || memcmp(h->magic, BakedMagic, sizeof(h->magic)) != 0)
+        _lastError = "not a baked font";
+    else if (h->byteOrder != BakedByteOrder)
+        _lastError = "baked for a different byte order";
+    else if (h->version != BakedVersion || h->headerSize != sizeof(BakedHeader))
+        _lastError = "unsupported version " + String(h->version);
+    else if (h->fileSize != size)
+        _lastError = "file truncated";
+    else if (!fits(h->presets, h->numPresets, sizeof(BakedPreset))
+          || !fits(h->regions, h->numRegions, sizeof(BakedRegion))
+          || !fits(h->refs, h->numRefs, sizeof(uint32))
+          || !fits(h->samples, h->numSamples, sizeof(BakedSample)))
+        _lastError = "tables out of bounds";
+    else
+        return true;
+    
+    return false;
+}
+
+bool BakedFont::fits (uint64 offset, uint64 count, size_t size) const
+{
+    return offset % 8 == 0 && offset <= _map->getSize() && count <= (_map->getSize() - offset) / size;
+}
+
+//---------------------------------------------------------
+//   Lookup
+//---------------------------------------------------------
+
+int BakedFont::getNumPresets() const
+{
+    return _header != nullptr ? (int)_header->numPresets : 0;
+}
+
+int BakedFont::getNumSamples() const
+{
+    return _header != nullptr ? (int)_header->numSamples : 0;
+}
+
+const BakedPreset* BakedFont::getPreset (int index) const
+{
+    if (_header == nullptr || index < 0 || (uint32)index >= _header->numPresets)
+        return nullptr;
+    return (const BakedPreset*)(_data + _header->presets) + index;
+}
+
+const BakedSample* BakedFont::getSample (int index) const
+{
+    if (_header == nullptr || index < 0 || (uint32)index >= _header->numSamples)
+        return nullptr;
+    return (const BakedSample*)(_data + _header->samples) + index;
+}
+
+const BakedRegion* BakedFont::getRegion (int index) const
+{
+    if (_header == nullptr || index < 0 || (uint32)index >= _header->numRegions)
+        return nullptr;
+    return (const BakedRegion*)(_data + _header->regions) + index;
+}
+
+const BakedPreset* BakedFont::findPreset (int bank, int program) const
+{
+    int lo = 0;
+    int hi = getNumPresets() - 1;
+    const int wanted = (bank << 16) | program;
+    
+    while (lo <= hi)
+    {
+        const int mid = (lo + hi) / 2;
+        const BakedPreset* p = getPreset(mid);
+        const int found = (p->bank << 16) | p->program;
+        if (found == wanted)
+            return p;
+        if (found < wanted)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return nullptr;
+}
+
+int BakedFont::findRegions (const BakedPreset* preset, int key, int velocity,
+                            const BakedRegion** regions, int maxRegions) const
+{
+    if (preset == nullptr || key < 0 || key > 127)
+        return 0;
+    
+    const uint32* refs = (const uint32*)(_data + _header->refs);
+    const uint32 last = jmin(preset->keys[key + 1], _header->numRefs);
+    int n = 0;
+    
+    for (uint32 i = preset->keys[key]; i < last && n < maxRegions; i++)
+    {
+        const BakedRegion* r = getRegion((int)refs[i]);
+        if (r != nullptr && velocity >= r->velLo && velocity <= r->velHi)
+            regions[n++] = r;
+    }
+    return n;
+}
+
+const short* BakedFont::getPCM (const BakedSample* sample) const
+{
+    // Checked here rather than on opening, which would touch every sample
+    if (sample == nullptr || !fits(sample->pcm, sample->frames + (uint64)BakedGuardFrames, sizeof(short)))
+        return nullptr;
+    return (const short*)(_data + sample->pcm);
+}
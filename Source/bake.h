@@ -0,0 +1,204 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BAKE_H__
+#define __BAKE_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "sfont.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   Baked file layout
+//---------------------------------------------------------
+
+/** A baked font is a SoundFont resolved for playback, meant to be memory
+    mapped and used in place by our players. It is no interchange format:
+    all fields are native-endian, and a file is only valid on machines of
+    the byte order it was written on.
+    
+    The file starts with a BakedHeader, followed by the tables it points
+    to, each 8 byte aligned. Presets are sorted by bank & program. Every
+    preset zone applied to every instrument zone yields one BakedRegion
+    with all generators resolved: instrument values with defaults filled
+    in, plus the preset's offsets, key & velocity ranges intersected and
+    sample offsets applied. Modulators are not baked, players apply the
+    default modulators of the SF2 spec.
+    
+    For each key, BakedPreset::keys[key] .. keys[key + 1] is the range of
+    entries in the table of region references to check for velocity.
+    The PCM of each sample is 16 bit, starts on a page boundary and is
+    followed by BakedGuardFrames of silence for interpolation. */
+
+static const char   BakedMagic[4]    = { 'S', 'F', '2', 'B' };
+static const uint32 BakedVersion     = 1;
+static const uint32 BakedByteOrder   = 0x01020304;  // reads differently if swapped
+static const int    BakedPageSize    = 4096;
+static const int    BakedGuardFrames = 46;          // as in SF2
+
+struct BakedHeader
+{
+    char   magic[4];
+    uint32 version;
+    uint32 byteOrder;
+    uint32 headerSize;      // sizeof(BakedHeader)
+    uint32 numPresets;
+    uint32 numRegions;
+    uint32 numRefs;
+    uint32 numSamples;
+    uint64 presets;         // offsets of the tables, in bytes from the start of the file
+    uint64 regions;
+    uint64 refs;            // uint32 region indices
+    uint64 samples;
+    uint64 fileSize;
+    char   name[64];
+};
+
+struct BakedPreset
+{
+    char   name[20];
+    uint16 bank;
+    uint16 program;
+    uint32 firstRegion;     // regions of a preset are consecutive
+    uint32 numRegions;
+    uint32 keys[129];       // per key, first entry in the region references
+};
+
+struct BakedRegion
+{
+    uint32 sample;
+    uint32 start;           // frames into the sample's PCM, offsets applied
+    uint32 end;
+    uint32 loopStart;
+    uint32 loopEnd;
+    uint8  keyLo, keyHi;
+    uint8  velLo, velHi;
+    int16  gens[Gen_Dummy]; // resolved values by Generator. Gen_OverrideRootKey
+                            // is the root key to use, Gen_SampleId the sample.
+};
+
+struct BakedSample
+{
+    char   name[20];
+    uint32 frames;
+    uint32 loopStart;       // relative to the first frame
+    uint32 loopEnd;
+    uint32 sampleRate;
+    int16  originalPitch;
+    int16  pitchCorrection;
+    uint16 type;            // SF2 sample type, without compression flags
+    uint16 reserved;
+    int32  link;
+    uint64 pcm;             // offset in bytes from the start of the file
+};
+
+//---------------------------------------------------------
+//   BakedWriter
+//---------------------------------------------------------
+
+/** Resolves a SoundFont into a baked file. All samples are loaded, so a
+    font opened with readHeaders() only is decoded on the way. */
+
+class BakedWriter
+{
+public:
+    BakedWriter (SoundFont& font);
+   ~BakedWriter();
+    
+    /** Replaces the file atomically */
+    bool write (const File& file);
+    
+    const String& getLastError() const  { return _lastError; }
+    int getNumRegions() const           { return _regions.size(); }
+
+private:
+    void resolve();
+    void resolvePreset (const Preset* preset, BakedPreset& baked);
+    void resolveZone (const Zone* presetGlobal, const Zone* presetZone,
+                      const Zone* instGlobal, const Zone* instZone);
+    void writeTables (OutputStream& out);
+    
+    SoundFont& _font;
+    Array<BakedPreset> _presets;
+    Array<BakedRegion> _regions;
+    Array<uint32> _refs;
+    Array<BakedSample> _samples;
+    BakedHeader _header;
+    String _lastError;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BakedWriter);
+};
+
+//---------------------------------------------------------
+//   BakedFont
+//---------------------------------------------------------
+
+/** A baked file mapped into memory. Opening checks the header and the
+    bounds of the tables only, so it takes the same time for any size of
+    font. Nothing is copied: all pointers point into the mapping and stay
+    valid as long as this object. Pages of PCM are read by the system as
+    they are first touched. */
+
+class BakedFont
+{
+public:
+    BakedFont (const File& file);
+   ~BakedFont();
+    
+    bool isValid() const                { return _header != nullptr; }
+    const String& getLastError() const  { return _lastError; }
+    
+    int getNumPresets() const;
+    int getNumSamples() const;
+    const BakedPreset* getPreset (int index) const;
+    const BakedSample* getSample (int index) const;
+    const BakedRegion* getRegion (int index) const;
+    
+    /** Binary search by bank & program, null if there is no such preset */
+    const BakedPreset* findPreset (int bank, int program) const;
+    
+    /** Collects up to maxRegions regions of a preset sounding for a key &
+        velocity, returns the number found */
+    int findRegions (const BakedPreset* preset, int key, int velocity,
+                     const BakedRegion** regions, int maxRegions) const;
+    
+    /** 16 bit mono PCM of a sample, followed by guard frames */
+    const short* getPCM (const BakedSample* sample) const;
+
+private:
+    bool check();
+    bool fits (uint64 offset, uint64 count, size_t size) const;
+    
+    ScopedPointer<MemoryMappedFile> _map;
+    const char* _data;
+    const BakedHeader* _header;
+    String _lastError;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BakedFont);
+};
+    
+} // namespace
+
+#endif
@@ -0,0 +1,670 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "batch.h"
+#include "index.h"
+#include "profiler.h"
+
+using namespace SF2;
+
+// Assembly frees a whole file's memory, so it runs before anything else
+static const int64 assembleCost = 0x7fffffffffffffffLL;
+
+//---------------------------------------------------------
+//   Conversion
+//---------------------------------------------------------
+
+/** State of one file in flight, shared by all tasks working on it */
+
+class BatchConverter::Conversion
+{
+public:
+    Conversion (BatchItem* i) :
+        item(i),
+        font(i->input),
+        remaining(0),
+        assembling(0),
+        failed(0),
+        started(Time::getMillisecondCounterHiRes())
+    {
+    }
+    
+    /** Any error fails the whole item, but the first message is the one that counts */
+    void setError (const String& message)
+    {
+        const ScopedLock sl (lock);
+        if (item->error.isEmpty())
+            item->error = message;
+        failed = 1;
+    }
+    
+    BatchItem* item;
+    SoundFont font;
+    OwnedArray<Encoding> encodings; // one per output
+    Atomic<int> remaining;  // decode & encode tasks not yet finished
+    Atomic<int> assembling; // outputs not yet written
+    Atomic<int> failed;
+    double started;
+    CriticalSection lock;
+    
+    JUCE_DECLARE_NON_COPYABLE (Conversion);
+};
+
+//---------------------------------------------------------
+//   AssembleTask
+//---------------------------------------------------------
+
+class BatchConverter::AssembleTask : public Task
+{
+public:
+    AssembleTask (BatchConverter& b, Conversion* c, int o) : batch(b), conversion(c), output(o) {}
+    
+    int64 getCost() const override
+    {
+        return assembleCost;
+    }
+    
+    void run (Scheduler&) override
+    {
+        BatchOutput* out = conversion->item->outputs.getUnchecked(output);
+        SoundFont& font = conversion->font;
+        
+        if (conversion->failed.get() == 0)
+        {
+            // Written next to the output and renamed into place, so readers never
+            // see a partial file. This also replaces a hard link into the cache
+            // rather than overwriting the cached file.
+            TemporaryFile temp (out->file, TemporaryFile::useHiddenFile);
+            
+            font.log("Writing " + out->file.getFullPathName());
+            const double started = Time::getMillisecondCounterHiRes();
+            bool ok = font.write(temp.getFile(), *conversion->encodings.getUnchecked(output));
+            out->writeSeconds = (Time::getMillisecondCounterHiRes() - started) / 1000.0;
+            
+            if (ok && !ConversionCache::replaceFile(temp.getFile(), out->file))
+            {
+                conversion->setError("cannot replace " + out->file.getFullPathName());
+                ok = false;
+            }
+            else if (!ok)
+                conversion->setError(font.getLastError());
+            
+            if (ok)
+            {
+                out->size = out->file.getSize();
+                if (batch._cache != nullptr && !batch._cache->store(out->cacheKey, out->file))
+                    font.log("Failed to add to cache: " + out->file.getFullPathName());
+            }
+        }
+        batch.outputDone(conversion);
+    }
+    
+private:
+    BatchConverter& batch;
+    Conversion* conversion;
+    const int output;
+};
+
+//---------------------------------------------------------
+//   EncodeTask
+//---------------------------------------------------------
+
+class BatchConverter::EncodeTask : public Task
+{
+public:
+    EncodeTask (BatchConverter& b, Conversion* c, int i, int o) : batch(b), conversion(c), index(i), output(o) {}
+    
+    int64 getCost() const override
+    {
+        return conversion->font.getSample(index)->numSamples() * (int64)sizeof(short);
+    }
+    
+    void run (Scheduler&) override
+    {
+        SoundFont& font = conversion->font;
+        
+        if (conversion->failed.get() == 0 && !font.encodeSample(index, *conversion->encodings.getUnchecked(output)))
+            conversion->setError("encoding failed: " + font.getSample(index)->name);
+        
+        batch.sampleDone(conversion);
+    }
+    
+private:
+    BatchConverter& batch;
+    Conversion* conversion;
+    const int index;
+    const int output;
+};
+
+//---------------------------------------------------------
+//   DecodeTask
+//---------------------------------------------------------
+
+class BatchConverter::DecodeTask : public Task
+{
+public:
+    DecodeTask (BatchConverter& b, Conversion* c, int i) : batch(b), conversion(c), index(i) {}
+    
+    int64 getCost() const override
+    {
+        // Samples or bytes in the file, depending on format. Not exact, but
+        // good enough to tell long samples from short ones.
+        const Sample* s = conversion->font.getSample(index);
+        return (int64)s->end - (int64)s->start;
+    }
+    
+    void run (Scheduler& scheduler) override
+    {
+        SoundFont& font = conversion->font;
+        
+        if (conversion->failed.get() == 0)
+        {
+            // Reading is parsing plus loading every sample, as in SoundFont::read()
+            ProfileScope scope (Profiler::Read);
+            scope.setLabel(font.getSample(index)->name);
+            
+            if (font.loadSample(index))
+                scope.addBytesIn(font.getSample(index)->storedBytes);
+            else
+                conversion->setError("read failed: " + font.getLastError());
+        }
+        
+        if (conversion->failed.get() == 0)
+        {
+            // Fan out to all encoders, SF2 output is written straight from sample data
+            for (int o = 0; o < conversion->encodings.size(); o++)
+            {
+                if (conversion->encodings.getUnchecked(o)->format != SF2Format
+                    && !conversion->item->outputs.getUnchecked(o)->cached)
+                {
+                    ++conversion->remaining;
+                    scheduler.add(new EncodeTask(batch, conversion, index, o));
+                }
+            }
+        }
+        batch.sampleDone(conversion);
+    }
+    
+private:
+    BatchConverter& batch;
+    Conversion* conversion;
+    const int index;
+};
+
+//---------------------------------------------------------
+//   ParseTask
+//---------------------------------------------------------
+
+class BatchConverter::ParseTask : public Task
+{
+public:
+    ParseTask (BatchConverter& b, Conversion* c) : batch(b), conversion(c) {}
+    
+    int64 getCost() const override
+    {
+        return conversion->item->sizeIn;
+    }
+    
+    void run (Scheduler& scheduler) override
+    {
+        BatchItem* item = conversion->item;
+        SoundFont& font = conversion->font;
+        
+        for (int o = 0; o < item->outputs.size(); o++)
+        {
+            Result dir = item->outputs.getUnchecked(o)->file.getParentDirectory().createDirectory();
+            if (dir.failed())
+            {
+                conversion->setError(dir.getErrorMessage());
+                batch.finish(conversion);
+                return;
+            }
+        }
+        
+        font.setVerbose(batch._verbose);
+        
+        if (batch._cache != nullptr && fetchFromCache())
+        {
+            font.log("Cached " + item->input.getFullPathName());
+            batch.finish(conversion);
+            return;
+        }
+        
+        font.log("Reading " + item->input.getFullPathName());
+        if (batch._index)
+            font.setIndexFile(FontIndex::getSidecarFile(item->input));
+        
+        bool ok;
+        const double started = Time::getMillisecondCounterHiRes();
+        {
+            // Sample data counts as read in DecodeTask
+            ProfileScope scope (Profiler::Read);
+            scope.setLabel(item->input.getFileName());
+            ok = font.readHeaders();
+        }
+        item->parseSeconds = (Time::getMillisecondCounterHiRes() - started) / 1000.0;
+        
+        if (!ok)
+        {
+            conversion->setError("read failed: " + font.getLastError());
+            batch.finish(conversion);
+            return;
+        }
+        
+        // Before any decoding, so the other presets' samples are never touched
+        if (batch._presets.isNotEmpty() && !font.selectPresets(batch._presets))
+        {
+            conversion->setError(font.getLastError());
+            batch.finish(conversion);
+            return;
+        }
+        
+        if (batch._prune && !font.prune())
+        {
+            conversion->setError(font.getLastError());
+            batch.finish(conversion);
+            return;
+        }
+        
+        const int numSamples = font.getNumSamples();
+        for (int o = 0; o < item->outputs.size(); o++)
+        {
+            const BatchOutput* out = item->outputs.getUnchecked(o);
+            Encoding* encoding = conversion->encodings.add(new Encoding(out->format, out->quality, numSamples));
+            encoding->layout = batch._layout;
+        }
+        conversion->assembling = item->outputs.size() - item->getNumCached();
+        conversion->remaining = numSamples;
+        
+        if (numSamples == 0)
+            batch.assemble(conversion);
+        
+        for (int i = 0; i < numSamples; i++)
+            scheduler.add(new DecodeTask(batch, conversion, i));
+    }
+    
+private:
+    /** Returns true if all outputs were found in the cache */
+    bool fetchFromCache()
+    {
+        BatchItem* item = conversion->item;
+        const String contentHash = ConversionCache::hashContent(item->input);
+        
+        for (int o = 0; o < item->outputs.size(); o++)
+        {
+            BatchOutput* out = item->outputs.getUnchecked(o);
+            out->cacheKey = ConversionCache::getKey(contentHash, out->format, out->quality, batch.getCacheOptions());
+            out->cached = batch._cache->fetch(out->cacheKey, out->file);
+            if (out->cached)
+                out->size = out->file.getSize();
+        }
+        return item->outputs.size() > 0 && item->getNumCached() == item->outputs.size();
+    }
+    
+    BatchConverter& batch;
+    Conversion* conversion;
+};
+
+//---------------------------------------------------------
+//   BatchConverter
+//---------------------------------------------------------
+
+BatchConverter::BatchConverter (FileType format, int quality) :
+    _format(format),
+    _quality(quality),
+    _verbose(false),
+    _report(false),
+    _index(false),
+    _prune(false),
+    _seconds(0),
+    _numDone(0),
+    _scheduler(nullptr),
+    _nextItem(0)
+{
+}
+
+BatchConverter::~BatchConverter()
+{
+    _items.clear();
+}
+
+void BatchConverter::setCacheDirectory (const File& directory)
+{
+    _cache = new ConversionCache(directory);
+}
+
+String BatchConverter::getFileExtension (FileType format)
+{
+    switch (format)
+    {
+        case SF3Format: return "sf3";
+        case SF4Format: return "sf4";
+        default:        return "sf2";
+    }
+}
+
+//---------------------------------------------------------
+//   parseOutputSpec
+//---------------------------------------------------------
+
+/** The path may contain colons, too */
+bool BatchConverter::parseOutputSpec (const String& spec, FileType& format, int& quality, String& path)
+{
+    const String name = spec.upToFirstOccurrenceOf(":", false, false).toLowerCase();
+    String rest = spec.fromFirstOccurrenceOf(":", false, false);
+    
+    if      (name == "sf2") format = SF2Format;
+    else if (name == "sf3") format = SF3Format;
+    else if (name == "sf4") format = SF4Format;
+    else return false;
+    
+    // A single digit before the next colon is the quality, otherwise
+    // this is a path, e.g. one with a Windows drive letter
+    quality = 2;
+    if (rest.length() > 2 && rest[1] == ':' && rest[0] >= '0' && rest[0] <= '2')
+    {
+        quality = rest[0] - '0';
+        rest = rest.substring(2);
+    }
+    path = rest;
+    return path.isNotEmpty();
+}
+
+//---------------------------------------------------------
+//   addFile
+//---------------------------------------------------------
+
+void BatchConverter::addFile (const File& in, const File& out)
+{
+    addFile(in)->addOutput(out, _format, _quality);
+}
+
+BatchItem* BatchConverter::addFile (const File& in)
+{
+    return _items.add(new BatchItem(in));
+}
+
+//---------------------------------------------------------
+//   addDirectory
+//---------------------------------------------------------
+
+int BatchConverter::addDirectory (const File& inDir, const File& outDir)
+{
+    Array<File> files;
+    inDir.findChildFiles(files, File::findFiles, true, "*.sf2;*.sf3;*.sf4");
+    
+    // Deterministic order, regardless of file system
+    files.sort();
+    
+    const String extension = getFileExtension(_format);
+    for (int i = 0; i < files.size(); i++)
+    {
+        const File& in = files.getReference(i);
+        File out = outDir.getChildFile(in.getRelativePathFrom(inDir)).withFileExtension(extension);
+        addFile(in, out);
+    }
+    return files.size();
+}
+
+//---------------------------------------------------------
+//   addManifest
+//---------------------------------------------------------
+
+int BatchConverter::addManifest (const File& manifest, const File& outDir)
+{
+    StringArray lines;
+    manifest.readLines(lines);
+    
+    const File base = manifest.getParentDirectory();
+    const String extension = getFileExtension(_format);
+    int added = 0;
+    
+    for (int i = 0; i < lines.size(); i++)
+    {
+        String line = lines[i].trim();
+        if (line.isEmpty() || line.startsWithChar('#'))
+            continue;
+        
+        // Tab separated, as file names may well contain spaces
+        File in = base.getChildFile(line.upToFirstOccurrenceOf("\t", false, false).trim());
+        String outName = line.fromFirstOccurrenceOf("\t", false, false).trim();
+        File out = outName.isNotEmpty()
+            ? base.getChildFile(outName)
+            : outDir.getChildFile(in.getFileName()).withFileExtension(extension);
+        
+        addFile(in, out);
+        added++;
+    }
+    return added;
+}
+
+//---------------------------------------------------------
+//   run
+//---------------------------------------------------------
+
+/** Sorts batch items by descending size */
+struct LargestFirstComparator
+{
+    static int compareElements (const BatchItem* a, const BatchItem* b)
+    {
+        return (a->sizeIn > b->sizeIn) ? -1 : ((b->sizeIn > a->sizeIn) ? 1 : 0);
+    }
+};
+
+int BatchConverter::run (int numThreads)
+{
+    Scheduler scheduler (numThreads);
+    return run(scheduler);
+}
+
+int BatchConverter::run (Scheduler& scheduler)
+{
+    const double started = Time::getMillisecondCounterHiRes();
+    _numDone = 0;
+    
+    enqueueLargestFirst();
+    _scheduler = &scheduler;
+    
+    // Enough files open to keep all workers busy, but not all of them
+    for (int i = 0; i < 2 * scheduler.getNumThreads(); i++)
+        admitNext();
+    
+    scheduler.waitUntilIdle();
+    _scheduler = nullptr;
+    
+    _seconds = (Time::getMillisecondCounterHiRes() - started) / 1000.0;
+    
+    int failed = 0;
+    for (int i = 0; i < _items.size(); i++)
+        if (!_items.getUnchecked(i)->ok)
+            failed++;
+    
+    return failed;
+}
+
+//---------------------------------------------------------
+//   enqueueLargestFirst
+//---------------------------------------------------------
+
+void BatchConverter::enqueueLargestFirst()
+{
+    _queue.clearQuick();
+    for (int i = 0; i < _items.size(); i++)
+    {
+        BatchItem* item = _items.getUnchecked(i);
+        item->sizeIn = item->input.getSize();
+        _queue.add(item);
+    }
+    LargestFirstComparator comparator;
+    _queue.sort(comparator, true);
+    _nextItem = 0;
+}
+
+//---------------------------------------------------------
+//   admitNext
+//---------------------------------------------------------
+
+void BatchConverter::admitNext()
+{
+    const ScopedLock sl (_admitLock);
+    
+    if (_nextItem < _queue.size())
+    {
+        Conversion* c = new Conversion(_queue.getUnchecked(_nextItem++));
+        _scheduler->add(new ParseTask(*this, c));
+    }
+}
+
+//---------------------------------------------------------
+//   sampleDone
+//---------------------------------------------------------
+
+void BatchConverter::sampleDone (Conversion* c)
+{
+    if (--c->remaining == 0)
+        assemble(c);
+}
+
+//---------------------------------------------------------
+//   assemble
+//---------------------------------------------------------
+
+void BatchConverter::assemble (Conversion* c)
+{
+    // All samples are decoded by now, unless one failed
+    c->font.updateIndex();
+    
+    // Nothing to write if all outputs came from the cache
+    if (c->assembling.get() == 0)
+    {
+        finish(c);
+        return;
+    }
+    
+    // Outputs are written independently of each other
+    for (int o = 0; o < c->item->outputs.size(); o++)
+        if (!c->item->outputs.getUnchecked(o)->cached)
+            _scheduler->add(new AssembleTask(*this, c, o));
+}
+
+//---------------------------------------------------------
+//   outputDone
+//---------------------------------------------------------
+
+void BatchConverter::outputDone (Conversion* c)
+{
+    if (--c->assembling == 0)
+        finish(c);
+}
+
+//---------------------------------------------------------
+//   finish
+//---------------------------------------------------------
+
+void BatchConverter::finish (Conversion* c)
+{
+    ScopedPointer<Conversion> done = c; // last task of this file
+    BatchItem* item = c->item;
+    item->ok = (c->failed.get() == 0);
+    
+    // Outputs are renamed into place when complete, so a failure leaves
+    // the previous output of this file as it was
+    for (int o = 0; o < item->outputs.size(); o++)
+        if (item->ok)
+            item->sizeOut += item->outputs.getUnchecked(o)->size;
+    
+    item->seconds = (Time::getMillisecondCounterHiRes() - c->started) / 1000.0;
+    
+    // Sample data & payloads are gone after this
+    if (_report)
+        item->report = ConversionReport::describeFile(*item, c->font, c->encodings);
+    
+    const int numDone = ++_numDone;
+    const char* status = !item->ok ? "FAILED" : (item->getNumCached() == item->outputs.size() ? "CACHED" : "OK    ");
+    if (_items.size() > 1)
+        fprintf(stderr, "[%d/%d] %s %s\n", numDone, _items.size(), status, item->input.getFullPathName().toRawUTF8());
+    
+    done = nullptr;
+    admitNext();
+}
+
+//---------------------------------------------------------
+//   getCacheOptions
+//---------------------------------------------------------
+
+/** Settings besides format & quality that change the outputs */
+String BatchConverter::getCacheOptions() const
+{
+    String options = _layout.getDescription();
+    if (_presets.isNotEmpty())
+        options << (options.isEmpty() ? "" : ", ") << "presets " << _presets;
+    if (_prune)
+        options << (options.isEmpty() ? "" : ", ") << "pruned";
+    return options;
+}
+
+//---------------------------------------------------------
+//   printSummary
+//---------------------------------------------------------
+
+void BatchConverter::printSummary() const
+{
+    int64 totalIn = 0, totalOut = 0;
+    int converted = 0, cached = 0;
+    
+    for (int i = 0; i < _items.size(); i++)
+    {
+        const BatchItem* item = _items.getUnchecked(i);
+        if (item->ok)
+        {
+            totalIn  += item->sizeIn;
+            totalOut += item->sizeOut;
+            converted++;
+            if (item->getNumCached() == item->outputs.size())
+                cached++;
+        }
+    }
+    
+    const int failed = _items.size() - converted;
+    fprintf(stderr, "\nConverted %d of %d files in %.1f s\n", converted, _items.size(), _seconds);
+    
+    if (_cache != nullptr)
+        fprintf(stderr, "Taken from cache: %d file(s)\n", cached);
+    
+    if (totalIn > 0)
+        fprintf(stderr, "Total size: %.1f MB -> %.1f MB (%d%%)\n",
+                totalIn / 1048576.0, totalOut / 1048576.0,
+                (int)round(100 * (double)totalOut / (double)totalIn));
+    
+    if (failed > 0)
+    {
+        fprintf(stderr, "\n%d file(s) failed:\n", failed);
+        for (int i = 0; i < _items.size(); i++)
+        {
+            const BatchItem* item = _items.getUnchecked(i);
+            if (!item->ok)
+                fprintf(stderr, "  %s: %s\n", item->input.getFullPathName().toRawUTF8(), item->error.toRawUTF8());
+        }
+    }
+}
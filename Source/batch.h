@@ -0,0 +1,215 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "sfont.h"
+#include "scheduler.h"
+#include "cache.h"
+#include "report.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   BatchOutput
+//---------------------------------------------------------
+
+/** One output file to be produced from an input file */
+
+class BatchOutput
+{
+public:
+    BatchOutput (const File& f, FileType fmt, int q) :
+        file(f), format(fmt), quality(q), size(0), cached(false), writeSeconds(0) {};
+   ~BatchOutput() {};
+    
+    File file;
+    FileType format;
+    int quality;
+    int64 size;
+    String cacheKey;
+    bool cached; // taken from the cache, not converted
+    double writeSeconds;
+    
+    JUCE_LEAK_DETECTOR (BatchOutput);
+};
+
+//---------------------------------------------------------
+//   BatchItem
+//---------------------------------------------------------
+
+/** One input file of a batch, with all outputs to be produced from
+    it, along with the outcome of its conversion */
+
+class BatchItem
+{
+public:
+    BatchItem (const File& in) :
+        input(in), ok(false), sizeIn(0), sizeOut(0), seconds(0), parseSeconds(0) {};
+   ~BatchItem() {};
+    
+    void addOutput (const File& file, FileType format, int quality)
+    {
+        outputs.add(new BatchOutput(file, format, quality));
+    }
+    
+    int getNumCached() const
+    {
+        int n = 0;
+        for (int o = 0; o < outputs.size(); o++)
+            if (outputs.getUnchecked(o)->cached)
+                n++;
+        return n;
+    }
+    
+    File input;
+    OwnedArray<BatchOutput> outputs;
+    bool ok;
+    int64 sizeIn;
+    int64 sizeOut; // all outputs
+    double seconds;
+    double parseSeconds;
+    String error;
+    var report; // see ConversionReport, if enabled
+    
+    JUCE_LEAK_DETECTOR (BatchItem);
+};
+
+//---------------------------------------------------------
+//   BatchConverter
+//---------------------------------------------------------
+
+/** Converts many files concurrently. Parsing, per-sample decoding and
+    encoding, and final assembly of every file are separate tasks on one
+    work-stealing Scheduler, so a single huge bank is spread across all
+    cores, while small banks keep the cores busy in between. Files are
+    started largest first, and only a bounded number are open at once. */
+
+class BatchConverter
+{
+public:
+    BatchConverter (FileType format, int quality);
+   ~BatchConverter();
+    
+    /** Adds all SoundFonts below inDir, mirroring the directory tree into outDir */
+    int addDirectory (const File& inDir, const File& outDir);
+    
+    /** Adds files listed in a manifest, one per line: infile [TAB outfile].
+        Relative paths resolve against the manifest's directory. Without an
+        outfile, the output goes to outDir. Lines starting with # are ignored. */
+    int addManifest (const File& manifest, const File& outDir);
+    
+    /** Adds a file converted with the default format & quality */
+    void addFile (const File& in, const File& out);
+    
+    /** Adds a file without outputs, so several can be added to the item. Each
+        sample is then decoded once and fed to all encoders concurrently. */
+    BatchItem* addFile (const File& in);
+    
+    /** Converts all files using numThreads workers, or one per CPU if zero.
+        Returns the number of files that failed. */
+    int run (int numThreads);
+    
+    /** Same, but on workers that outlive this converter, e.g. in a server.
+        The scheduler must not run other tasks at the same time. */
+    int run (Scheduler& scheduler);
+    
+    void printSummary() const;
+    void setVerbose (bool verbose)  { _verbose = verbose; }
+    
+    /** Looks up outputs in a cache directory before converting, and adds
+        new outputs to it. Inputs are identified by content, not by name. */
+    void setCacheDirectory (const File& directory);
+    
+    /** Arrangement of sample data in all outputs, e.g. aligned to 4096
+        bytes for page aligned reads. By default it is packed in file order. */
+    void setSampleLayout (const SampleLayout& layout)  { _layout = layout; }
+    
+    /** Keeps only these presets of every input, as a bank:program list.
+        Only their samples are decoded & encoded. See SoundFont::selectPresets() */
+    void setPresetSelection (const String& list)  { _presets = list; }
+    
+    /** Removes instruments & samples no preset uses before converting,
+        so they are neither decoded nor written. See SoundFont::prune() */
+    void setPruneEnabled (bool enabled)   { _prune = enabled; }
+    
+    /** Reads headers from sidecar indexes next to the inputs, writing them
+        where missing or stale. See FontIndex. */
+    void setIndexEnabled (bool enabled)   { _index = enabled; }
+    
+    /** Keeps per-sample statistics of every file for ConversionReport */
+    void setReportEnabled (bool enabled)  { _report = enabled; }
+    
+    double getSeconds() const               { return _seconds; }
+    int getNumItems() const                 { return _items.size(); }
+    const BatchItem* getItem (int i) const  { return _items[i]; }
+    
+    static String getFileExtension (FileType format);
+    
+    /** Parses an output spec format[:quality]:path, e.g. sf3:0:low.sf3 */
+    static bool parseOutputSpec (const String& spec, FileType& format, int& quality, String& path);
+    
+private:
+    friend class ShardedBatch;
+    
+    class Conversion;
+    class ParseTask;
+    class DecodeTask;
+    class EncodeTask;
+    class AssembleTask;
+    
+    void enqueueLargestFirst();
+    void admitNext();
+    void sampleDone (Conversion* c);
+    void assemble (Conversion* c);
+    void outputDone (Conversion* c);
+    void finish (Conversion* c);
+    String getCacheOptions() const;
+    
+    FileType _format;
+    int _quality;
+    bool _verbose;
+    bool _report;
+    bool _index;
+    bool _prune;
+    SampleLayout _layout;
+    String _presets;
+    double _seconds;
+    Atomic<int> _numDone;
+    OwnedArray<BatchItem> _items;
+    ScopedPointer<ConversionCache> _cache;
+    
+    Scheduler* _scheduler;
+    Array<BatchItem*> _queue; // largest first
+    int _nextItem;
+    CriticalSection _admitLock;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchConverter);
+};
+    
+} // namespace
+
+#endif
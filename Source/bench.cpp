@@ -0,0 +1,724 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.h"
+#include "analysis.h"
+#include "batch.h"
+#include "memstats.h"
+
+using namespace SF2;
+
+//---------------------------------------------------------
+//   SyntheticBank
+//---------------------------------------------------------
+
+SyntheticBank::Options::Options() :
+    numSamples(64),
+    minLength(4096),
+    maxLength(65536),
+    stereoRatio(0.25),
+    zonesPerInstrument(4),
+    generatorsPerZone(8),
+    seed(1)
+{
+}
+
+/** Typical instrument zone generators, with plausible amounts */
+struct FillerGenerator
+{
+    Generator gen;
+    int amount;
+};
+
+static const FillerGenerator fillerGenerators[] =
+{
+    { Gen_SampleModes,       1 },
+    { Gen_Pan,               0 },
+    { Gen_Attenuation,     100 },
+    { Gen_VolEnvAttack,  -7200 },
+    { Gen_VolEnvDecay,    -200 },
+    { Gen_VolEnvSustain,   300 },
+    { Gen_VolEnvRelease,  1200 },
+    { Gen_FilterFc,       9000 },
+    { Gen_FilterQ,          50 },
+    { Gen_ReverbSend,      200 },
+    { Gen_ChorusSend,      100 },
+    { Gen_FineTune,          0 },
+};
+
+SoundFont* SyntheticBank::create (const Options& o)
+{
+    Random random (o.seed);
+    SoundFont* font = new SoundFont (File());
+    font->setVerbose(false);
+    font->_name = "Synthetic";
+    font->_engine = "EMU8000";
+    font->_version.major = 2;
+    font->_version.minor = 1;
+    
+    const int numSamples = jmax(1, o.numSamples);
+    const int minLength  = jmax(64, o.minLength);
+    const int maxLength  = jmax(minLength, o.maxLength);
+    const int numPairs   = jmin(numSamples / 2, roundToInt(numSamples * jlimit(0.0, 1.0, o.stereoRatio) / 2.0));
+    
+    // Stereo pairs first, each a left and a right channel of equal length
+    for (int i = 0; i < numSamples; i++)
+    {
+        const bool paired = i < numPairs * 2;
+        Sample* s = new Sample;
+        s->name = "Synth " + String(i).paddedLeft('0', 5);
+        
+        if (paired && (i & 1))
+        {
+            const Sample* left = font->_samples.getLast();
+            fillSample(s, left->numSamples(), left->origpitch, 0.5, random);
+            s->sampletype = SampleType::Right;
+            s->sampleLink = i - 1;
+        }
+        else
+        {
+            const int length = minLength + random.nextInt(maxLength - minLength + 1);
+            fillSample(s, length, 36 + random.nextInt(48), 0.0, random);
+            if (paired)
+            {
+                s->sampletype = SampleType::Left;
+                s->sampleLink = i + 1;
+            }
+        }
+        
+        s->createMeta();
+        font->_samples.add(s);
+    }
+    
+    // One instrument per group of samples, split across the keyboard,
+    // and one preset per instrument
+    const int zonesPerInstrument = jmax(1, o.zonesPerInstrument);
+    const int numFillers = jlimit(0, numElementsInArray(fillerGenerators), o.generatorsPerZone - 2);
+    
+    for (int first = 0; first < numSamples; first += zonesPerInstrument)
+    {
+        const int numZones = jmin(zonesPerInstrument, numSamples - first);
+        Instrument* instrument = new Instrument;
+        instrument->index = font->_instruments.size();
+        instrument->name = "Instrument " + String(instrument->index);
+        
+        for (int z = 0; z < numZones; z++)
+        {
+            const Sample* s = font->_samples.getUnchecked(first + z);
+            
+            // Both channels of a pair play the same keys
+            const int slot = (s->sampletype == SampleType::Right && z > 0) ? z - 1 : z;
+            
+            // Key range comes first and sample id last, as the spec requires
+            Zone* zone = new Zone;
+            zone->instrumentIndex = 0;
+            zone->generators.add(createKeyRange(slot * 128 / numZones, (slot + 1) * 128 / numZones - 1));
+            
+            for (int g = 0; g < numFillers; g++)
+            {
+                const FillerGenerator& f = fillerGenerators[g];
+                const int variation = f.gen == Gen_SampleModes ? 0 : random.nextInt(201) - 100;
+                zone->generators.add(createGenerator(f.gen, f.amount + variation));
+            }
+            zone->generators.add(createGenerator(Gen_SampleId, first + z));
+            
+            instrument->zones.add(zone);
+            font->_iZones.add(zone);
+        }
+        font->_instruments.add(instrument);
+        
+        Preset* preset = new Preset;
+        preset->name = "Preset " + String(instrument->index);
+        preset->preset = instrument->index % 128;
+        preset->bank = instrument->index / 128;
+        
+        Zone* zone = new Zone;
+        zone->instrumentIndex = instrument->index;
+        zone->generators.add(createKeyRange(0, 127));
+        zone->generators.add(createGenerator(Gen_Instrument, instrument->index));
+        
+        preset->zones.add(zone);
+        font->_pZones.add(zone);
+        font->_presets.add(preset);
+    }
+    
+    font->_metadataSize = font->estimateMetadataSize();
+    MemoryStats::allocated(MemoryStats::Metadata, font->_metadataSize);
+    return font;
+}
+
+/** A decaying tone with a few harmonics and some noise, which keeps
+    lossless codecs from compressing it unrealistically well */
+void SyntheticBank::fillSample (Sample* s, int length, int pitch, double phase, Random& random)
+{
+    s->samplerate = 44100;
+    s->origpitch = pitch;
+    s->start = 0;
+    s->end = length;
+    s->loopstart = length / 4;
+    s->loopend = length - 8;
+    s->allocateSampleData(length);
+    
+    const double step = 2.0 * double_Pi * 440.0 * std::pow(2.0, (pitch - 69) / 12.0) / s->samplerate;
+    const double decay = std::pow(0.1, 1.0 / length);
+    const double amplitude = 4000.0 + random.nextInt(8000);
+    double envelope = 1.0;
+    
+    for (int n = 0; n < length; n++)
+    {
+        const double x = step * n + phase;
+        const double tone = std::sin(x) + 0.5 * std::sin(2.0 * x) + 0.25 * std::sin(3.0 * x);
+        const double noise = random.nextInt(129) - 64;
+        s->sampleData[n] = (short)jlimit(-32768.0, 32767.0, amplitude * envelope * tone + noise);
+        envelope *= decay;
+    }
+    
+    s->loadState.set(Sample::Loaded);
+}
+
+GeneratorList* SyntheticBank::createGenerator (Generator gen, int amount)
+{
+    GeneratorList* g = new GeneratorList;
+    g->gen = gen;
+    g->amount.sword = (short)amount;
+    return g;
+}
+
+GeneratorList* SyntheticBank::createKeyRange (int lo, int hi)
+{
+    GeneratorList* g = new GeneratorList;
+    g->gen = Gen_KeyRange;
+    g->amount.lo = (byte)lo;
+    g->amount.hi = (byte)hi;
+    return g;
+}
+
+
+//---------------------------------------------------------
+//   Benchmark
+//---------------------------------------------------------
+
+Benchmark::Benchmark (const SyntheticBank::Options& o) :
+    options(o),
+    pcmBytes(0),
+    stepIndex(0),
+    stepStarted(0),
+    allocationsBefore(0),
+    memoryBefore(0)
+{
+}
+
+Benchmark::~Benchmark()
+{
+}
+
+const double Benchmark::minVorbisSnr = 10.0;
+
+bool Benchmark::run (int repeats)
+{
+    steps.clearQuick();
+    
+    bool ok = true;
+    for (int r = 0; r < jmax(1, repeats); r++)
+    {
+        stepIndex = 0;
+        checks.clearQuick();
+        ok = runOnce() && ok;
+    }
+    return ok;
+}
+
+bool Benchmark::runOnce()
+{
+    beginStep();
+    bank = SyntheticBank::create(options);
+    pcmBytes = 0;
+    for (int i = 0; i < bank->getNumSamples(); i++)
+        pcmBytes += bank->getSample(i)->numSamples() * (int64)sizeof(short);
+    endStep("generate", SF2Format, 0, pcmBytes);
+    
+    // SF2 has no quality setting, all others are run at each
+    bool ok = runFormat(SF2Format, 0);
+    
+    const FileType formats[] = { SF3Format, SF4Format };
+    for (int f = 0; f < 2; f++)
+        for (int quality = 0; quality <= 2; quality++)
+            ok = runFormat(formats[f], quality) && ok;
+    
+    return ok;
+}
+
+bool Benchmark::runFormat (FileType format, int quality)
+{
+    const int numSamples = bank->getNumSamples();
+    Encoding encoding (format, quality, numSamples);
+    
+    Check failure;
+    failure.format = format;
+    failure.quality = quality;
+    failure.passed = false;
+    failure.minSnr = 0;
+    
+    // SF2 is written straight from sample data
+    if (format != SF2Format)
+    {
+        beginStep();
+        int64 encoded = 0;
+        bool ok = true;
+        for (int i = 0; ok && i < numSamples; i++)
+        {
+            ok = bank->encodeSample(i, encoding);
+            if (ok)
+                encoded += encoding.payloads.getUnchecked(i)->getSize();
+        }
+        endStep("encode", format, quality, encoded);
+        
+        if (!ok)
+        {
+            failure.error = "encoding failed: " + bank->getLastError();
+            checks.add(failure);
+            return false;
+        }
+    }
+    
+    MemoryOutputStream out;
+    beginStep();
+    const bool written = bank->write(out, encoding, "synthetic." + BatchConverter::getFileExtension(format));
+    endStep("write", format, quality, (int64)out.getDataSize());
+    
+    if (!written)
+    {
+        failure.error = "writing failed: " + bank->getLastError();
+        checks.add(failure);
+        return false;
+    }
+    
+    // Decoding reads straight from the written data
+    SoundFont decoded (new MemoryInputStream(out.getData(), out.getDataSize(), false));
+    decoded.setVerbose(false);
+    beginStep();
+    const bool read = decoded.read();
+    endStep("read", format, quality, (int64)out.getDataSize());
+    
+    if (!read)
+    {
+        failure.error = "reading failed: " + decoded.getLastError();
+        checks.add(failure);
+        return false;
+    }
+    
+    const Check check = verify(format, quality, decoded);
+    checks.add(check);
+    return check.passed;
+}
+
+//---------------------------------------------------------
+//   Steps
+//---------------------------------------------------------
+
+void Benchmark::beginStep()
+{
+    MemoryStats::resetPeaks();
+    memoryBefore = MemoryStats::getTotalCurrent();
+    allocationsBefore = getNumAllocations();
+    stepStarted = Time::getMillisecondCounterHiRes();
+}
+
+void Benchmark::endStep (const String& name, FileType format, int quality, int64 bytes)
+{
+    Step step;
+    step.seconds = (Time::getMillisecondCounterHiRes() - stepStarted) / 1000.0;
+    step.name = name;
+    step.format = format;
+    step.quality = quality;
+    step.bytes = bytes;
+    step.allocations = getNumAllocations() - allocationsBefore;
+    step.peakBytes = MemoryStats::getTotalPeak() - memoryBefore;
+    
+    // Repeats keep the fastest time, which is the least disturbed
+    if (stepIndex < steps.size())
+    {
+        Step& previous = steps.getReference(stepIndex);
+        step.seconds = jmin(step.seconds, previous.seconds);
+        step.allocations = jmax(step.allocations, previous.allocations);
+        step.peakBytes = jmax(step.peakBytes, previous.peakBytes);
+        previous = step;
+    }
+    else
+        steps.add(step);
+    
+    stepIndex++;
+}
+
+int64 Benchmark::getNumAllocations()
+{
+    int64 n = 0;
+    for (int i = 0; i < MemoryStats::NumCategories; i++)
+        n += MemoryStats::getNumAllocations((MemoryStats::Category)i);
+    return n;
+}
+
+//---------------------------------------------------------
+//   Verification
+//---------------------------------------------------------
+
+/** Lossless formats must restore every sample bit by bit. Vorbis must
+    restore lengths and loops, and its fidelity is measured as SNR. */
+Benchmark::Check Benchmark::verify (FileType format, int quality, const SoundFont& decoded) const
+{
+    Check check;
+    check.format = format;
+    check.quality = quality;
+    check.passed = true;
+    check.minSnr = 0;
+    
+    if (decoded.getNumSamples() != bank->getNumSamples())
+    {
+        check.passed = false;
+        check.error = "number of samples differs";
+        return check;
+    }
+    
+    for (int i = 0; i < bank->getNumSamples(); i++)
+    {
+        const Sample* o = bank->getSample(i);
+        const Sample* d = decoded.getSample(i);
+        
+        if (!d->isLoaded() || !d->checkMeta())
+            check.error = "length or loop not restored: " + o->name;
+        
+        else if (format == SF3Format)
+        {
+            const double snr = CodecAnalysis::getSnr(o, d);
+            check.minSnr = i == 0 ? snr : jmin(check.minSnr, snr);
+            if (snr < minVorbisSnr)
+                check.error = "SNR " + String(snr, 1) + " dB too low: " + o->name;
+        }
+        else if (d->numSamples() != o->numSamples()
+                 || d->loopstart != o->loopstart
+                 || d->loopend != o->loopend
+                 || memcmp(d->sampleData, o->sampleData, o->numSamples() * sizeof(short)) != 0)
+            check.error = "sample data differs: " + o->name;
+        
+        if (check.error.isNotEmpty())
+        {
+            check.passed = false;
+            break;
+        }
+    }
+    return check;
+}
+
+//---------------------------------------------------------
+//   Results
+//---------------------------------------------------------
+
+var Benchmark::getResults() const
+{
+    DynamicObject::Ptr config = new DynamicObject();
+    config->setProperty("samples", options.numSamples);
+    config->setProperty("minLength", options.minLength);
+    config->setProperty("maxLength", options.maxLength);
+    config->setProperty("stereoRatio", options.stereoRatio);
+    config->setProperty("zonesPerInstrument", options.zonesPerInstrument);
+    config->setProperty("generatorsPerZone", options.generatorsPerZone);
+    config->setProperty("seed", options.seed);
+    config->setProperty("pcmBytes", pcmBytes);
+    
+    // Throughput is based on the uncompressed size, so codecs compare
+    const int numSamples = bank != nullptr ? bank->getNumSamples() : 0;
+    Array<var> stepList;
+    for (int i = 0; i < steps.size(); i++)
+    {
+        const Step& s = steps.getReference(i);
+        DynamicObject::Ptr step = new DynamicObject();
+        step->setProperty("step", s.name);
+        step->setProperty("format", BatchConverter::getFileExtension(s.format));
+        step->setProperty("quality", s.quality);
+        step->setProperty("codec", bank->getEncoderSetting(s.format, s.quality));
+        step->setProperty("seconds", s.seconds);
+        step->setProperty("samplesPerSecond", s.seconds > 0 ? numSamples / s.seconds : 0.0);
+        step->setProperty("mbPerSecond", s.seconds > 0 ? pcmBytes / 1048576.0 / s.seconds : 0.0);
+        step->setProperty("bytes", s.bytes);
+        step->setProperty("allocations", s.allocations);
+        step->setProperty("peakBytes", s.peakBytes);
+        stepList.add(step.get());
+    }
+    
+    Array<var> checkList;
+    for (int i = 0; i < checks.size(); i++)
+    {
+        const Check& c = checks.getReference(i);
+        DynamicObject::Ptr check = new DynamicObject();
+        check->setProperty("format", BatchConverter::getFileExtension(c.format));
+        check->setProperty("quality", c.quality);
+        check->setProperty("passed", c.passed);
+        if (c.format == SF3Format)
+            check->setProperty("minSnr", c.minSnr);
+        if (c.error.isNotEmpty())
+            check->setProperty("error", c.error);
+        checkList.add(check.get());
+    }
+    
+    DynamicObject::Ptr results = new DynamicObject();
+    results->setProperty("tool", ProjectInfo::projectName);
+    results->setProperty("version", ProjectInfo::versionString);
+    results->setProperty("bank", config.get());
+    results->setProperty("steps", stepList);
+    results->setProperty("verification", checkList);
+    results->setProperty("peakResidentSize", MemoryStats::getPeakResidentSize());
+    return results.get();
+}
+
+void Benchmark::printSummary() const
+{
+    const int numSamples = bank != nullptr ? bank->getNumSamples() : 0;
+    fprintf(stderr, "\nSynthetic bank: %d samples, %.1f MB PCM\n", numSamples, pcmBytes / 1048576.0);
+    fprintf(stderr, "\n%-9s %-7s %-18s %9s %11s %9s %9s %8s %9s\n",
+            "Step", "Format", "Codec", "Seconds", "Samples/s", "MB/s", "MB", "Allocs", "Peak MB");
+    
+    for (int i = 0; i < steps.size(); i++)
+    {
+        const Step& s = steps.getReference(i);
+        const String format = BatchConverter::getFileExtension(s.format) + (s.format != SF2Format ? ":" + String(s.quality) : String());
+        fprintf(stderr, "%-9s %-7s %-18s %9.3f %11.1f %9.1f %9.1f %8lld %9.1f\n",
+                s.name.toRawUTF8(), format.toRawUTF8(),
+                bank->getEncoderSetting(s.format, s.quality).toRawUTF8(), s.seconds,
+                s.seconds > 0 ? numSamples / s.seconds : 0.0,
+                s.seconds > 0 ? pcmBytes / 1048576.0 / s.seconds : 0.0,
+                s.bytes / 1048576.0, (long long)s.allocations, s.peakBytes / 1048576.0);
+    }
+    
+    fprintf(stderr, "\n");
+    for (int i = 0; i < checks.size(); i++)
+    {
+        const Check& c = checks.getReference(i);
+        String line;
+        line << "Verify " << BatchConverter::getFileExtension(c.format) << ":" << c.quality << "  "
+             << (c.passed ? "passed" : "FAILED");
+        if (c.format == SF3Format && c.passed)
+            line << ", min SNR " << String(c.minSnr, 1) << " dB";
+        if (c.error.isNotEmpty())
+            line << ", " << c.error;
+        fprintf(stderr, "%s\n", line.toRawUTF8());
+    }
+}
+
+
+//---------------------------------------------------------
+//   RegressionSuite
+//---------------------------------------------------------
+
+RegressionSuite::Tolerances::Tolerances() :
+    time(0.25),
+    allocations(0.0),
+    memory(0.10),
+    snr(1.0)
+{
+}
+
+RegressionSuite::RegressionSuite()
+{
+    // Many short samples, metadata heavy
+    SyntheticBank::Options drums;
+    drums.numSamples = 512;
+    drums.minLength = 1024;
+    drums.maxLength = 8192;
+    drums.stereoRatio = 0.5;
+    drums.zonesPerInstrument = 16;
+    drums.generatorsPerZone = 14;
+    drums.seed = 1;
+    
+    // The defaults, a typical General MIDI bank
+    SyntheticBank::Options mixed;
+    mixed.seed = 2;
+    
+    // Few long samples, codec bound
+    SyntheticBank::Options pads;
+    pads.numSamples = 8;
+    pads.minLength = 262144;
+    pads.maxLength = 524288;
+    pads.stereoRatio = 1.0;
+    pads.zonesPerInstrument = 2;
+    pads.generatorsPerZone = 4;
+    pads.seed = 3;
+    
+    names.add("drums");
+    benchmarks.add(new Benchmark(drums));
+    names.add("mixed");
+    benchmarks.add(new Benchmark(mixed));
+    names.add("pads");
+    benchmarks.add(new Benchmark(pads));
+}
+
+RegressionSuite::~RegressionSuite()
+{
+}
+
+bool RegressionSuite::run (int repeats)
+{
+    bool ok = true;
+    for (int i = 0; i < benchmarks.size(); i++)
+    {
+        fprintf(stderr, "Running %s ...\n", names[i].toRawUTF8());
+        ok = benchmarks.getUnchecked(i)->run(repeats) && ok;
+    }
+    return ok;
+}
+
+var RegressionSuite::getResults() const
+{
+    DynamicObject::Ptr banks = new DynamicObject();
+    for (int i = 0; i < benchmarks.size(); i++)
+        banks->setProperty(names[i], benchmarks.getUnchecked(i)->getResults());
+    
+    DynamicObject::Ptr results = new DynamicObject();
+    results->setProperty("tool", ProjectInfo::projectName);
+    results->setProperty("version", ProjectInfo::versionString);
+    results->setProperty("banks", banks.get());
+    return results.get();
+}
+
+void RegressionSuite::printSummary() const
+{
+    for (int i = 0; i < benchmarks.size(); i++)
+    {
+        fprintf(stderr, "\n== %s ==\n", names[i].toRawUTF8());
+        benchmarks.getUnchecked(i)->printSummary();
+    }
+}
+
+String RegressionSuite::getStepKey (const var& step)
+{
+    return step["step"].toString() + " " + step["format"].toString() + ":" + step["quality"].toString();
+}
+
+String RegressionSuite::getCheckKey (const var& check)
+{
+    return check["format"].toString() + ":" + check["quality"].toString();
+}
+
+var RegressionSuite::find (const var& list, const String& key, String (*getKey) (const var&))
+{
+    if (const Array<var>* entries = list.getArray())
+        for (int i = 0; i < entries->size(); i++)
+            if (getKey(entries->getReference(i)) == key)
+                return entries->getReference(i);
+    return var();
+}
+
+/** Times are compared with an absolute slack on top, since steps of a
+    few milliseconds vary by more than any sensible relative tolerance */
+int RegressionSuite::compare (const var& baseline, const Tolerances& t) const
+{
+    const double timeSlack = 0.005;
+    const int64 memorySlack = 65536;
+    int regressions = 0;
+    
+    if (!baseline["banks"].isObject())
+    {
+        fprintf(stderr, "Baseline contains no banks\n");
+        return 1;
+    }
+    
+    fprintf(stderr, "\nComparing with baseline of %s %s\n",
+            baseline["tool"].toString().toRawUTF8(), baseline["version"].toString().toRawUTF8());
+    
+    for (int b = 0; b < benchmarks.size(); b++)
+    {
+        const String& name = names[b];
+        const var current = benchmarks.getUnchecked(b)->getResults();
+        const var base = baseline["banks"][Identifier(name)];
+        if (!base.isObject())
+        {
+            fprintf(stderr, "  %s: not in baseline, skipped\n", name.toRawUTF8());
+            continue;
+        }
+        
+        // Steps are matched by name, format & quality
+        const Array<var>* steps = current["steps"].getArray();
+        for (int i = 0; steps != nullptr && i < steps->size(); i++)
+        {
+            const var& step = steps->getReference(i);
+            const String key = getStepKey(step);
+            const var before = find(base["steps"], key, getStepKey);
+            if (!before.isObject())
+            {
+                fprintf(stderr, "  %s %s: not in baseline, skipped\n", name.toRawUTF8(), key.toRawUTF8());
+                continue;
+            }
+            
+            const double seconds = step["seconds"], baseSeconds = before["seconds"];
+            if (seconds > baseSeconds * (1.0 + t.time) + timeSlack)
+            {
+                fprintf(stderr, "  REGRESSION %s %s: %.3f s, baseline %.3f s (%+.0f%%)\n",
+                        name.toRawUTF8(), key.toRawUTF8(), seconds, baseSeconds,
+                        baseSeconds > 0 ? 100.0 * (seconds / baseSeconds - 1.0) : 100.0);
+                regressions++;
+            }
+            
+            const int64 allocations = step["allocations"], baseAllocations = before["allocations"];
+            if (allocations > baseAllocations * (1.0 + t.allocations))
+            {
+                fprintf(stderr, "  REGRESSION %s %s: %lld allocations, baseline %lld\n",
+                        name.toRawUTF8(), key.toRawUTF8(), (long long)allocations, (long long)baseAllocations);
+                regressions++;
+            }
+            
+            const int64 peak = step["peakBytes"], basePeak = before["peakBytes"];
+            if (peak > basePeak * (1.0 + t.memory) + memorySlack)
+            {
+                fprintf(stderr, "  REGRESSION %s %s: peak %.1f MB, baseline %.1f MB\n",
+                        name.toRawUTF8(), key.toRawUTF8(), peak / 1048576.0, basePeak / 1048576.0);
+                regressions++;
+            }
+        }
+        
+        // Lossy fidelity must not drop either
+        const Array<var>* checks = current["verification"].getArray();
+        for (int i = 0; checks != nullptr && i < checks->size(); i++)
+        {
+            const var& check = checks->getReference(i);
+            const String key = getCheckKey(check);
+            const var before = find(base["verification"], key, getCheckKey);
+            if (!check.hasProperty("minSnr") || !before.hasProperty("minSnr"))
+                continue;
+            
+            const double snr = check["minSnr"], baseSnr = before["minSnr"];
+            if (snr < baseSnr - t.snr)
+            {
+                fprintf(stderr, "  REGRESSION %s verify %s: min SNR %.1f dB, baseline %.1f dB\n",
+                        name.toRawUTF8(), key.toRawUTF8(), snr, baseSnr);
+                regressions++;
+            }
+        }
+    }
+    
+    if (regressions > 0)
+        fprintf(stderr, "\n*** %d PERFORMANCE REGRESSION%s ***\n", regressions, regressions > 1 ? "S" : "");
+    else
+        fprintf(stderr, "\nNo regressions against baseline\n");
+    
+    return regressions;
+}
@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "sfont.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   SyntheticBank
+//---------------------------------------------------------
+
+/** Builds SoundFonts in memory from a handful of parameters, so that
+    conversion speed can be compared across versions and machines without
+    shipping sample libraries. The same options always give the same bank. */
+
+class SyntheticBank
+{
+public:
+    struct Options
+    {
+        Options();
+        
+        int numSamples;
+        int minLength;          // sample frames, lengths are spread evenly
+        int maxLength;
+        double stereoRatio;     // share of samples in stereo pairs, 0..1
+        int zonesPerInstrument;
+        int generatorsPerZone;  // including key range & sample id
+        int64 seed;
+    };
+    
+    /** Returns a font with all sample data loaded, ready to be encoded
+        and written. The caller takes ownership. */
+    static SoundFont* create (const Options& options);
+
+private:
+    static void fillSample (Sample* s, int length, int pitch, double phase, Random& random);
+    static GeneratorList* createGenerator (Generator gen, int amount);
+    static GeneratorList* createKeyRange (int lo, int hi);
+};
+
+//---------------------------------------------------------
+//   Benchmark
+//---------------------------------------------------------
+
+/** Times every step of a conversion on a synthetic bank: writing and
+    reading back SF2, then encoding, writing, decoding and verifying it for
+    each codec and quality. Runs on the calling thread only, so results
+    depend on the codecs rather than on the number of cores. */
+
+class Benchmark
+{
+public:
+    Benchmark (const SyntheticBank::Options& options);
+   ~Benchmark();
+    
+    /** Returns false if any step failed, or a decoded bank did not verify.
+        With several repeats, each step reports its fastest run. */
+    bool run (int repeats = 1);
+    
+    /** Options, one entry per step and the verification results */
+    var getResults() const;
+    void printSummary() const;
+    
+    /** Vorbis samples decoded below this are considered broken, dB */
+    static const double minVorbisSnr;
+
+private:
+    struct Step
+    {
+        String name;
+        FileType format;
+        int quality;
+        double seconds;
+        int64 bytes;        // size of the output, or of the input for reading
+        int64 allocations;
+        int64 peakBytes;    // above what was allocated before the step
+    };
+    
+    struct Check
+    {
+        FileType format;
+        int quality;
+        bool passed;
+        double minSnr;      // dB, lossy codecs only
+        String error;
+    };
+    
+    bool runOnce();
+    bool runFormat (FileType format, int quality);
+    void beginStep();
+    void endStep (const String& name, FileType format, int quality, int64 bytes);
+    Check verify (FileType format, int quality, const SoundFont& decoded) const;
+    
+    static int64 getNumAllocations();
+    
+    const SyntheticBank::Options options;
+    ScopedPointer<SoundFont> bank;
+    int64 pcmBytes;
+    Array<Step> steps;
+    Array<Check> checks;
+    
+    int stepIndex;          // within the current repeat
+    double stepStarted;
+    int64 allocationsBefore;
+    int64 memoryBefore;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Benchmark);
+};
+
+//---------------------------------------------------------
+//   RegressionSuite
+//---------------------------------------------------------
+
+/** Benchmarks a fixed set of synthetic banks, from many short samples with
+    dense metadata to a few long ones, and compares them with the results
+    of an earlier run, e.g. of the last release on the same machine. */
+
+class RegressionSuite
+{
+public:
+    /** Allowed increases over the baseline, relative; SNR decrease in dB */
+    struct Tolerances
+    {
+        Tolerances();
+        
+        double time;
+        double allocations;
+        double memory;
+        double snr;
+    };
+    
+    RegressionSuite();
+   ~RegressionSuite();
+    
+    /** Returns false if any bank failed to convert or verify */
+    bool run (int repeats);
+    
+    /** Results per bank, which serve as the baseline of later runs */
+    var getResults() const;
+    void printSummary() const;
+    
+    /** Prints every regression found, and returns their number */
+    int compare (const var& baseline, const Tolerances& tolerances) const;
+
+private:
+    static String getStepKey (const var& step);
+    static String getCheckKey (const var& check);
+    static var find (const var& list, const String& key, String (*getKey) (const var&));
+    
+    StringArray names;
+    OwnedArray<Benchmark> benchmarks;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RegressionSuite);
+};
+    
+} // namespace
+
+#endif
@@ -0,0 +1,160 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cache.h"
+
+#if ! JUCE_WINDOWS
+#include <unistd.h>
+#endif
+
+using namespace SF2;
+
+//---------------------------------------------------------
+//   ConversionCache
+//---------------------------------------------------------
+
+ConversionCache::ConversionCache (const File& directory) :
+    _directory(directory)
+{
+}
+
+//---------------------------------------------------------
+//   hashContent
+//---------------------------------------------------------
+
+String ConversionCache::hashContent (const File& input)
+{
+    return SHA256(input).toHexString();
+}
+
+//---------------------------------------------------------
+//   getKey
+//---------------------------------------------------------
+
+String ConversionCache::getKey (const String& contentHash, FileType format, int quality, const String& options)
+{
+    // Any change of the encoder may change the output, hence the version
+    String settings;
+    settings << contentHash << ":" << (int)format << ":" << quality << ":" << ProjectInfo::versionString;
+    
+    // Packed outputs keep the keys they always had
+    if (options.isNotEmpty())
+        settings << ":" << options;
+    return SHA256(settings.toRawUTF8(), strlen(settings.toRawUTF8())).toHexString();
+}
+
+//---------------------------------------------------------
+//   getEntry
+//---------------------------------------------------------
+
+File ConversionCache::getEntry (const String& key) const
+{
+    // Two levels, so directories stay small
+    return _directory.getChildFile(key.substring(0, 2)).getChildFile(key);
+}
+
+//---------------------------------------------------------
+//   link
+//---------------------------------------------------------
+
+/** Hard-links target to source, or copies it if links are not supported,
+    e.g. across file systems */
+bool ConversionCache::link (const File& source, const File& target)
+{
+    target.deleteFile();
+
+#if ! JUCE_WINDOWS
+    if (::link(source.getFullPathName().toRawUTF8(), target.getFullPathName().toRawUTF8()) == 0)
+        return true;
+#endif
+    
+    return source.copyFileTo(target);
+}
+
+//---------------------------------------------------------
+//   replaceFile
+//---------------------------------------------------------
+
+bool ConversionCache::replaceFile (const File& source, const File& target)
+{
+#if JUCE_WINDOWS
+    return source.moveFileTo(target);
+#else
+    return ::rename(source.getFullPathName().toRawUTF8(), target.getFullPathName().toRawUTF8()) == 0;
+#endif
+}
+
+//---------------------------------------------------------
+//   fetch
+//---------------------------------------------------------
+
+bool ConversionCache::fetch (const String& key, const File& output)
+{
+    const File entry = getEntry(key);
+    if (!entry.existsAsFile())
+        return false;
+    
+    if (output.getParentDirectory().createDirectory().failed())
+        return false;
+    
+    // Linked or copied next to the output and renamed into place, so
+    // readers never see the output missing or half-copied
+    TemporaryFile temp (output, TemporaryFile::useHiddenFile);
+    if (!link(entry, temp.getFile()) || !replaceFile(temp.getFile(), output))
+        return false;
+    
+    // A link keeps the time of the entry, which would make the output look
+    // older than its input, e.g. to WatchService. This touches the entry too.
+    output.setLastModificationTime(Time::getCurrentTime());
+    return true;
+}
+
+//---------------------------------------------------------
+//   store
+//---------------------------------------------------------
+
+bool ConversionCache::store (const String& key, const File& output)
+{
+    const File entry = getEntry(key);
+    if (entry.existsAsFile())
+        return true;
+    
+    if (entry.getParentDirectory().createDirectory().failed())
+        return false;
+    
+    // Concurrent builds may share the cache, so entries appear atomically
+    String tempName;
+    tempName << key << "-" << Process::getCurrentProcessId() << "-"
+             << String::toHexString((int64)(pointer_sized_int)Thread::getCurrentThreadId()) << ".tmp";
+    const File temp = entry.getSiblingFile(tempName);
+    if (!link(output, temp))
+        return false;
+    
+    if (!replaceFile(temp, entry))
+    {
+        temp.deleteFile();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "sfont.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   ConversionCache
+//---------------------------------------------------------
+
+/** Local store of conversion results, keyed by a hash of the input file's
+    content, the output format & quality, and the version of this tool.
+    Encoding is deterministic, so a hit is exactly what a conversion would
+    produce. Hits are hard-linked to the output where possible, else copied. */
+
+class ConversionCache
+{
+public:
+    ConversionCache (const File& directory);
+   ~ConversionCache() {};
+    
+    /** Hash of the input file content, to be computed once per input */
+    static String hashContent (const File& input);
+    
+    /** Cache key of one output of an input with the given content hash. Options
+        are any other settings the output depends on, e.g. the sample layout. */
+    static String getKey (const String& contentHash, FileType format, int quality, const String& options = String());
+    
+    /** Places the cached result at output. Returns false on a miss. */
+    bool fetch (const String& key, const File& output);
+    
+    /** Adds a freshly written output to the cache */
+    bool store (const String& key, const File& output);
+    
+    const File& getDirectory() const  { return _directory; }
+    
+    /** Renames source onto target in one step where the OS can, so readers
+        see either file in full. File::moveFileTo() deletes the target first. */
+    static bool replaceFile (const File& source, const File& target);
+
+private:
+    File getEntry (const String& key) const;
+    static bool link (const File& source, const File& target);
+    
+    File _directory;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ConversionCache);
+};
+    
+} // namespace
+
+#endif
@@ -0,0 +1,372 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "index.h"
+
+using namespace SF2;
+
+static const int indexMagic = (int)ByteOrder::littleEndianInt("SF2I");
+static const int indexVersion = 2;
+static const int stampBytes = 65536; // hashed at either end of the font
+
+static uint64 fnv (const void* data, size_t size, uint64 h = 14695981039346656037ULL)
+{
+    const uint8* p = (const uint8*)data;
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+
+//---------------------------------------------------------
+//   Stamp
+//---------------------------------------------------------
+
+File FontIndex::getSidecarFile (const File& font)
+{
+    return font.getSiblingFile(font.getFileName() + ".idx");
+}
+
+bool FontIndex::getStamp (const File& font, Stamp& stamp)
+{
+    FileInputStream in (font);
+    if (!in.openedOk())
+        return false;
+    
+    stamp.size = in.getTotalLength();
+    stamp.modified = font.getLastModificationTime().toMilliseconds();
+    
+    HeapBlock<char> buffer (stampBytes);
+    int n = in.read(buffer, stampBytes);
+    stamp.hash = fnv(buffer, (size_t)jmax(0, n));
+    
+    if (stamp.size > stampBytes)
+    {
+        in.setPosition(jmax((int64)stampBytes, stamp.size - stampBytes));
+        n = in.read(buffer, stampBytes);
+        stamp.hash = fnv(buffer, (size_t)jmax(0, n), stamp.hash);
+    }
+    return true;
+}
+
+uint64 FontIndex::hashSample (const Sample* s)
+{
+    if (s->sampleData == nullptr)
+        return 0;
+    
+    // 0 means unknown
+    return jmax((uint64)1, fnv(s->sampleData, s->sampleDataSize * sizeof(short)));
+}
+
+//---------------------------------------------------------
+//   save
+//---------------------------------------------------------
+
+bool FontIndex::save (const SoundFont& font, const File& index)
+{
+    Stamp stamp;
+    if (!getStamp(font._path, stamp))
+        return false;
+    
+    MemoryOutputStream out;
+    out.writeInt(indexMagic);
+    out.writeInt(indexVersion);
+    out.writeInt64(stamp.size);
+    out.writeInt64(stamp.modified);
+    out.writeInt64((int64)stamp.hash);
+    
+    out.writeInt(font._fileFormatIn);
+    out.writeInt(font._version.major);
+    out.writeInt(font._version.minor);
+    out.writeInt64(font._samplePos);
+    out.writeInt64(font._sampleLen);
+    
+    const String* info[] = {
+        &font._engine, &font._name, &font._date, &font._comment,
+        &font._tools, &font._creator, &font._product, &font._copyright
+    };
+    for (int i = 0; i < numElementsInArray(info); i++)
+        out.writeString(*info[i]);
+    
+    out.writeInt(font._presets.size());
+    for (int i = 0; i < font._presets.size(); i++)
+    {
+        const Preset* p = font._presets.getUnchecked(i);
+        out.writeString(p->name);
+        out.writeInt(p->preset);
+        out.writeInt(p->bank);
+        out.writeInt(p->library);
+        out.writeInt(p->genre);
+        out.writeInt(p->morphology);
+        writeZones(out, p->zones);
+    }
+    
+    out.writeInt(font._instruments.size());
+    for (int i = 0; i < font._instruments.size(); i++)
+    {
+        const Instrument* instrument = font._instruments.getUnchecked(i);
+        out.writeString(instrument->name);
+        writeZones(out, instrument->zones);
+    }
+    
+    // Offsets as in the file, which change once a sample is loaded
+    jassert (font._headersIn.size() == font._samples.size());
+    out.writeInt(font._samples.size());
+    for (int i = 0; i < font._samples.size(); i++)
+    {
+        const Sample* s = font._samples.getUnchecked(i);
+        const SoundFont::SampleHeader& h = font._headersIn.getReference(i);
+        out.writeString(s->name);
+        out.writeInt((int)h.start);
+        out.writeInt((int)h.end);
+        out.writeInt((int)h.loopstart);
+        out.writeInt((int)h.loopend);
+        out.writeInt(h.sampletype);
+        out.writeInt((int)s->samplerate);
+        out.writeInt(s->origpitch);
+        out.writeInt(s->pitchadj);
+        out.writeInt(s->sampleLink);
+        
+        // Decoded length & relative loop, if known
+        const bool loaded = s->isLoaded();
+        out.writeBool(loaded || s->meta != nullptr);
+        out.writeInt(loaded ? s->numSamples() : (s->meta != nullptr ? (int)s->meta->samples : 0));
+        out.writeInt(loaded ? (int)s->loopstart : (s->meta != nullptr ? (int)s->meta->loopstart : 0));
+        out.writeInt(loaded ? (int)s->loopend : (s->meta != nullptr ? (int)s->meta->loopend : 0));
+        
+        const uint64 known = font._sampleHashes[i];
+        out.writeInt64((int64)(loaded ? hashSample(s) : known));
+    }
+    
+    out.writeInt(font._heads.size());
+    for (int i = 0; i < font._heads.size(); i++)
+    {
+        out.writeInt((int)font._heads.getReference(i).start);
+        out.writeInt((int)font._heads.getReference(i).frames);
+    }
+    
+    out.writeInt(indexMagic);
+    return index.replaceWithData(out.getData(), out.getDataSize());
+}
+
+void FontIndex::writeZones (OutputStream& out, const OwnedArray<Zone>& zones)
+{
+    out.writeInt(zones.size());
+    for (int z = 0; z < zones.size(); z++)
+    {
+        const Zone* zone = zones.getUnchecked(z);
+        
+        out.writeInt(zone->generators.size());
+        for (int g = 0; g < zone->generators.size(); g++)
+        {
+            const GeneratorList* gen = zone->generators.getUnchecked(g);
+            out.writeShort((short)gen->gen);
+            out.writeShort((short)gen->amount.uword);
+        }
+        
+        out.writeInt(zone->modulators.size());
+        for (int m = 0; m < zone->modulators.size(); m++)
+        {
+            const ModulatorList* mod = zone->modulators.getUnchecked(m);
+            out.writeShort((short)mod->src);
+            out.writeShort((short)mod->dst);
+            out.writeShort((short)mod->amount);
+            out.writeShort((short)mod->amtSrc);
+            out.writeShort((short)mod->transform);
+        }
+    }
+}
+
+//---------------------------------------------------------
+//   load
+//---------------------------------------------------------
+
+bool FontIndex::load (SoundFont& font, const File& index)
+{
+    jassert (font._presets.size() == 0 && font._samples.size() == 0);
+    
+    MemoryBlock data;
+    if (!index.loadFileAsData(data))
+        return false;
+    
+    MemoryInputStream in (data, false);
+    if (in.readInt() != indexMagic || in.readInt() != indexVersion)
+        return false;
+    
+    Stamp stamp;
+    if (!getStamp(font._path, stamp))
+        return false;
+    
+    if (in.readInt64() != stamp.size
+        || in.readInt64() != stamp.modified
+        || (uint64)in.readInt64() != stamp.hash)
+        return false;
+    
+    // Built aside, so a corrupt index leaves the font untouched
+    OwnedArray<Preset> presets;
+    OwnedArray<Instrument> instruments;
+    OwnedArray<Sample> samples;
+    Array<Zone*> pZones, iZones;
+    Array<SoundFont::SampleHeader> headers;
+    Array<uint64> hashes;
+    Array<SampleHead> heads;
+    StringArray info;
+    int format;
+    sfVersionTag version;
+    int64 samplePos, sampleLen;
+    
+    try {
+        format = in.readInt();
+        if (format < SF2Format || format > SF4Format)
+            throw String("unknown format");
+        version.major = in.readInt();
+        version.minor = in.readInt();
+        samplePos = in.readInt64();
+        sampleLen = in.readInt64();
+        
+        for (int i = 0; i < 8; i++)
+            info.add(in.readString());
+        
+        for (int i = readCount(in, 24); --i >= 0; )
+        {
+            Preset* p = presets.add(new Preset);
+            p->name = in.readString();
+            p->preset = in.readInt();
+            p->bank = in.readInt();
+            p->library = in.readInt();
+            p->genre = in.readInt();
+            p->morphology = in.readInt();
+            readZones(in, p->zones, pZones);
+        }
+        
+        for (int i = readCount(in, 5); --i >= 0; )
+        {
+            Instrument* instrument = instruments.add(new Instrument);
+            instrument->name = in.readString();
+            readZones(in, instrument->zones, iZones);
+        }
+        
+        for (int i = readCount(in, 58); --i >= 0; )
+        {
+            Sample* s = samples.add(new Sample);
+            s->name = in.readString();
+            s->start = (uint)in.readInt();
+            s->end = (uint)in.readInt();
+            s->loopstart = (uint)in.readInt();
+            s->loopend = (uint)in.readInt();
+            s->sampletype = in.readInt();
+            s->samplerate = (uint)in.readInt();
+            s->origpitch = in.readInt();
+            s->pitchadj = in.readInt();
+            s->sampleLink = in.readInt();
+            headers.add(SoundFont::SampleHeader(s, s->getCompressionType()));
+            
+            const bool hasLength = in.readBool();
+            const int length = in.readInt();
+            const int loopstart = in.readInt();
+            const int loopend = in.readInt();
+            if (hasLength)
+            {
+                SampleMeta* m = s->createMeta();
+                m->samples = (uint)length;
+                m->loopstart = (uint)loopstart;
+                m->loopend = (uint)loopend;
+            }
+            hashes.add((uint64)in.readInt64());
+        }
+        
+        for (int i = readCount(in, 8); --i >= 0; )
+        {
+            SampleHead h;
+            h.start = (uint)in.readInt();
+            h.frames = (uint)in.readInt();
+            heads.add(h);
+        }
+        
+        // Reading beyond the end yields zeros rather than failing
+        if (in.readInt() != indexMagic)
+            throw String("index truncated");
+    }
+    catch (juce::String) {
+        return false;
+    }
+    
+    font._fileFormatIn = (FileType)format;
+    font._version = version;
+    font._samplePos = samplePos;
+    font._sampleLen = sampleLen;
+    
+    String* fields[] = {
+        &font._engine, &font._name, &font._date, &font._comment,
+        &font._tools, &font._creator, &font._product, &font._copyright
+    };
+    for (int i = 0; i < numElementsInArray(fields); i++)
+        *fields[i] = info[i];
+    
+    font._presets.swapWith(presets);
+    font._instruments.swapWith(instruments);
+    font._samples.swapWith(samples);
+    font._pZones.swapWith(pZones);
+    font._iZones.swapWith(iZones);
+    font._headersIn.swapWith(headers);
+    font._sampleHashes.swapWith(hashes);
+    font._heads.swapWith(heads);
+    return true;
+}
+
+void FontIndex::readZones (InputStream& in, OwnedArray<Zone>& zones, Array<Zone*>& all)
+{
+    for (int z = readCount(in, 8); --z >= 0; )
+    {
+        Zone* zone = zones.add(new Zone);
+        zone->instrumentIndex = 0;
+        all.add(zone);
+        
+        for (int g = readCount(in, 4); --g >= 0; )
+        {
+            GeneratorList* gen = zone->generators.add(new GeneratorList);
+            gen->gen = static_cast<Generator>((ushort)in.readShort());
+            gen->amount.uword = (ushort)in.readShort();
+        }
+        
+        for (int m = readCount(in, 10); --m >= 0; )
+        {
+            ModulatorList* mod = zone->modulators.add(new ModulatorList);
+            mod->src = static_cast<Modulator>((ushort)in.readShort());
+            mod->dst = static_cast<Generator>((ushort)in.readShort());
+            mod->amount = in.readShort();
+            mod->amtSrc = static_cast<Modulator>((ushort)in.readShort());
+            mod->transform = static_cast<Transform>((ushort)in.readShort());
+        }
+    }
+}
+
+/** A count of records of at least recordSize bytes each, which must fit
+    into what is left of the index, so a corrupt count can't allocate much */
+int FontIndex::readCount (InputStream& in, int recordSize)
+{
+    const int count = in.readInt();
+    if (count < 0 || count > in.getNumBytesRemaining() / recordSize)
+        throw String("index corrupt");
+    return count;
+}
@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __INDEX_H__
+#define __INDEX_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "sfont.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   FontIndex
+//---------------------------------------------------------
+
+/** Sidecar file with the parsed headers of a SoundFont, for fonts that are
+    opened again and again but whose format we don't control.
+    
+    It holds the preset, instrument & zone tables, the sample headers as
+    found in the file, and once samples were loaded, their decoded lengths
+    and content hashes. With an index, SoundFont::readHeaders() skips the
+    pdta chunk and goes straight to loading samples on demand.
+    
+    An index is only used while the font file has the same size and
+    modification time, and the same hash of its first and last 64 KB,
+    which hold the INFO and pdta chunks in practice. Otherwise it is
+    ignored, and replaced after parsing the font. See SoundFont::setIndexFile(). */
+
+class FontIndex
+{
+public:
+    /** Default location next to the font, e.g. Piano.sf2.idx */
+    static File getSidecarFile (const File& font);
+    
+    /** Restores the headers of a font from an index, unless it is missing,
+        corrupt, or stale. The font must not have any headers yet. */
+    static bool load (SoundFont& font, const File& index);
+    
+    /** Writes the headers of a font, including lengths & hashes of all
+        samples loaded so far. Replaces the index atomically. */
+    static bool save (const SoundFont& font, const File& index);
+    
+    /** 64 bit FNV-1a of the decoded sample data, 0 if not loaded */
+    static uint64 hashSample (const Sample* s);
+
+private:
+    struct Stamp
+    {
+        int64 size;
+        int64 modified;
+        uint64 hash;
+    };
+    
+    static bool getStamp (const File& font, Stamp& stamp);
+    static void writeZones (OutputStream& out, const OwnedArray<Zone>& zones);
+    static void readZones (InputStream& in, OwnedArray<Zone>& zones, Array<Zone*>& all);
+    static int readCount (InputStream& in, int recordSize);
+};
+    
+} // namespace
+
+#endif
@@ -0,0 +1,260 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "libsf2convert.h"
+#include "sfont.h"
+
+using namespace SF2;
+
+//---------------------------------------------------------
+//   sf2_font
+//---------------------------------------------------------
+
+struct sf2_font
+{
+    sf2_font (SoundFont* f) : font(f)
+    {
+        font->setVerbose(false);
+        if (!font->readHeaders())
+            setError();
+    }
+    
+    void setError()
+    {
+        error = font->getLastError();
+        if (error.isEmpty())
+            error = "unknown error";
+    }
+    
+    ScopedPointer<SoundFont> font;
+    ScopedPointer<Encoding> encoding; // of the last conversion
+    MemoryBlock output;
+    String error;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (sf2_font);
+};
+
+//---------------------------------------------------------
+//   Opening & closing
+//---------------------------------------------------------
+
+/** Exceptions must not reach C callers. The only one expected here is
+    std::bad_alloc, as read errors are caught by SoundFont itself. */
+
+sf2_font* sf2_open_memory (const void* data, size_t size, int copy)
+{
+    try {
+        return new sf2_font(new SoundFont(new MemoryInputStream(data, size, copy != 0)));
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+sf2_font* sf2_open_file (const char* path)
+{
+    try {
+        return new sf2_font(new SoundFont(File::getCurrentWorkingDirectory().getChildFile(String::fromUTF8(path))));
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void sf2_close (sf2_font* f)
+{
+    delete f;
+}
+
+const char* sf2_error (const sf2_font* f)
+{
+    return (f == nullptr || f->error.isEmpty()) ? nullptr : f->error.toRawUTF8();
+}
+
+//---------------------------------------------------------
+//   Presets & samples
+//---------------------------------------------------------
+
+int sf2_num_presets (const sf2_font* f)
+{
+    return f->font->getNumPresets();
+}
+
+int sf2_num_samples (const sf2_font* f)
+{
+    return f->font->getNumSamples();
+}
+
+int sf2_get_preset (const sf2_font* f, int index, sf2_preset_info* info)
+{
+    const Preset* p = f->font->getPreset(index);
+    if (p == nullptr)
+        return -1;
+    
+    info->name = p->name.toRawUTF8();
+    info->bank = p->bank;
+    info->preset = p->preset;
+    info->num_zones = p->zones.size();
+    return 0;
+}
+
+int sf2_get_sample (const sf2_font* f, int index, sf2_sample_info* info)
+{
+    const Sample* s = f->font->getSample(index);
+    if (s == nullptr)
+        return -1;
+    
+    info->name = s->name.toRawUTF8();
+    info->sample_rate = s->samplerate;
+    info->original_pitch = s->origpitch;
+    info->pitch_correction = s->pitchadj;
+    info->link = s->sampleLink;
+    info->type = s->sampletype & ~(TypeVorbis | TypeFlac);
+    
+    // Offsets in the file are bytes for compressed samples, and loops absolute
+    // for raw ones, until loaded. See Sample.
+    if (s->isLoaded())
+    {
+        info->frames = (size_t)s->numSamples();
+        info->loop_start = s->loopstart;
+        info->loop_end = s->loopend;
+    }
+    else if (s->meta != nullptr)
+    {
+        info->frames = s->meta->samples;
+        info->loop_start = s->meta->loopstart;
+        info->loop_end = s->meta->loopend;
+    }
+    else if ((s->sampletype & (TypeVorbis | TypeFlac)) == 0)
+    {
+        info->frames = s->end - s->start;
+        info->loop_start = s->loopstart - s->start;
+        info->loop_end = s->loopend - s->start;
+    }
+    else
+    {
+        info->frames = 0;
+        info->loop_start = 0;
+        info->loop_end = 0;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------
+//   Sample data
+//---------------------------------------------------------
+
+const short* sf2_get_pcm (sf2_font* f, int index, size_t* frames)
+{
+    try {
+        if (!f->font->loadSample(index))
+        {
+            f->setError();
+            return nullptr;
+        }
+    }
+    catch (...) {
+        f->error = "out of memory";
+        return nullptr;
+    }
+    
+    const Sample* s = f->font->getSample(index);
+    if (frames != nullptr)
+        *frames = (size_t)s->numSamples();
+    return s->sampleData;
+}
+
+long sf2_decode_sample (sf2_font* f, int index, short* buffer, size_t capacity)
+{
+    size_t frames = 0;
+    const short* pcm = sf2_get_pcm(f, index, &frames);
+    if (pcm == nullptr)
+        return -1;
+    
+    if (buffer != nullptr)
+        memcpy(buffer, pcm, jmin(frames, capacity) * sizeof(short));
+    return (long)frames;
+}
+
+//---------------------------------------------------------
+//   Conversion
+//---------------------------------------------------------
+
+const void* sf2_convert (sf2_font* f, int format, int quality, size_t* size)
+{
+    if (format < SF2_FORMAT_SF2 || format > SF2_FORMAT_SF4)
+    {
+        f->error = "unknown format";
+        return nullptr;
+    }
+    
+    SoundFont& font = *f->font;
+    try {
+        f->encoding = new Encoding((FileType)format, jlimit(0, 2, quality), font.getNumSamples());
+        f->output.reset();
+        
+        // Loads each sample on the way
+        for (int i = 0; i < font.getNumSamples(); i++)
+        {
+            if (!font.encodeSample(i, *f->encoding))
+            {
+                f->setError();
+                return nullptr;
+            }
+        }
+        
+        // Trims the block to the data written when going out of scope
+        MemoryOutputStream out (f->output, false);
+        if (!font.write(out, *f->encoding))
+        {
+            f->setError();
+            return nullptr;
+        }
+    }
+    catch (...) {
+        f->error = "out of memory";
+        return nullptr;
+    }
+    
+    f->error = String();
+    if (size != nullptr)
+        *size = f->output.getSize();
+    return f->output.getData();
+}
+
+const void* sf2_get_payload (const sf2_font* f, int index, size_t* size)
+{
+    const MemoryBlock* payload = f->encoding != nullptr ? f->encoding->payloads[index] : nullptr;
+    if (payload == nullptr)
+        return nullptr;
+    
+    if (size != nullptr)
+        *size = payload->getSize();
+    return payload->getData();
+}
+
+const char* sf2_version (void)
+{
+    return ProjectInfo::versionString;
+}
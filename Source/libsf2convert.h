@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __LIBSF2CONVERT_H__
+#define __LIBSF2CONVERT_H__
+
+/** C interface of libsf2convert, for reading & converting SoundFonts in
+    process, without JUCE or C++ on the caller's side.
+    
+    A font handle must not be used by several threads at once, but
+    different handles are independent. Pointers handed out by a handle
+    (names, PCM data, converted output) point into memory owned by it:
+    nothing is copied, and they stay valid until the handle is closed,
+    or for sf2_convert() and sf2_get_payload(), until the next call to
+    sf2_convert(). */
+
+#include <stddef.h>
+
+#if defined (_WIN32)
+ #if defined (SF2CONVERT_BUILD_LIBRARY)
+  #define SF2_API __declspec(dllexport)
+ #else
+  #define SF2_API __declspec(dllimport)
+ #endif
+#else
+ #define SF2_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sf2_font sf2_font;
+
+/** Same values as SF2::FileType */
+enum
+{
+    SF2_FORMAT_SF2 = 0,
+    SF2_FORMAT_SF3 = 1,     /* Ogg Vorbis */
+    SF2_FORMAT_SF4 = 2      /* FLAC */
+};
+
+typedef struct sf2_preset_info
+{
+    const char* name;
+    int bank;
+    int preset;
+    int num_zones;
+} sf2_preset_info;
+
+/** frames and loops are 0 if unknown before decoding, which is the case for
+    compressed samples without verification data from the converter */
+typedef struct sf2_sample_info
+{
+    const char* name;
+    size_t frames;
+    size_t loop_start;      /* relative to the first frame */
+    size_t loop_end;
+    unsigned sample_rate;
+    int original_pitch;
+    int pitch_correction;
+    int link;               /* index of the other channel of a stereo pair */
+    int type;               /* SF2 sample type, without compression flags */
+} sf2_sample_info;
+
+/** Opens a font from memory. Unless copy is non-zero, the data is used in
+    place and must outlive the handle. Like all functions returning a
+    handle, this returns NULL only if out of memory. Check sf2_error()
+    afterwards and close the handle in any case. Only headers are read,
+    samples are decoded on demand. */
+SF2_API sf2_font* sf2_open_memory (const void* data, size_t size, int copy);
+
+/** Opens a font file, relative paths resolve against the working directory */
+SF2_API sf2_font* sf2_open_file (const char* path);
+
+SF2_API void sf2_close (sf2_font* font);
+
+/** Message of the last error, or NULL if none occurred */
+SF2_API const char* sf2_error (const sf2_font* font);
+
+SF2_API int sf2_num_presets (const sf2_font* font);
+SF2_API int sf2_num_samples (const sf2_font* font);
+
+/** Return 0 on success, -1 if the index is out of range */
+SF2_API int sf2_get_preset (const sf2_font* font, int index, sf2_preset_info* info);
+SF2_API int sf2_get_sample (const sf2_font* font, int index, sf2_sample_info* info);
+
+/** Decodes a sample if needed and returns its 16 bit mono PCM data in place,
+    or NULL on failure. frames receives the length. */
+SF2_API const short* sf2_get_pcm (sf2_font* font, int index, size_t* frames);
+
+/** Same, but copies up to capacity frames into a buffer provided by the
+    caller. Returns the length of the sample in frames, or -1 on failure. */
+SF2_API long sf2_decode_sample (sf2_font* font, int index, short* buffer, size_t capacity);
+
+/** Converts the whole font to format at quality 0..2, like -zo0 .. -zf2.
+    Returns the file contents, or NULL on failure. size receives the length. */
+SF2_API const void* sf2_convert (sf2_font* font, int format, int quality, size_t* size);
+
+/** Compressed payload of one sample from the last sf2_convert() to SF3 or
+    SF4, i.e. an Ogg Vorbis stream or FLAC file. NULL if there is none. */
+SF2_API const void* sf2_get_payload (const sf2_font* font, int index, size_t* size);
+
+SF2_API const char* sf2_version (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
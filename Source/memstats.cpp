@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "memstats.h"
+
+#if JUCE_WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#pragma comment (lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace SF2;
+
+Atomic<int64> MemoryStats::_current[MemoryStats::NumCategories];
+Atomic<int64> MemoryStats::_peak[MemoryStats::NumCategories];
+Atomic<int64> MemoryStats::_allocations[MemoryStats::NumCategories];
+Atomic<int64> MemoryStats::_totalCurrent;
+Atomic<int64> MemoryStats::_totalPeak;
+
+//---------------------------------------------------------
+//   MemoryStats
+//---------------------------------------------------------
+
+void MemoryStats::allocated (Category c, int64 bytes)
+{
+    ++_allocations[c];
+    updatePeak(_peak[c], _current[c] += bytes);
+    updatePeak(_totalPeak, _totalCurrent += bytes);
+}
+
+void MemoryStats::freed (Category c, int64 bytes)
+{
+    _current[c] -= bytes;
+    _totalCurrent -= bytes;
+}
+
+void MemoryStats::resetPeaks()
+{
+    for (int i = 0; i < NumCategories; i++)
+        _peak[i].set(_current[i].get());
+    
+    _totalPeak.set(_totalCurrent.get());
+}
+
+void MemoryStats::updatePeak (Atomic<int64>& peak, int64 value)
+{
+    for (;;)
+    {
+        const int64 previous = peak.get();
+        if (value <= previous || peak.compareAndSetBool(value, previous))
+            break;
+    }
+}
+
+const char* MemoryStats::getCategoryName (Category c)
+{
+    switch (c)
+    {
+        case Metadata:      return "metadata";
+        case PCM:           return "PCM";
+        case Compressed:    return "compressed";
+        case CodecScratch:  return "codec scratch";
+        default:            return "";
+    }
+}
+
+//---------------------------------------------------------
+//   getPeakResidentSize
+//---------------------------------------------------------
+
+int64 MemoryStats::getPeakResidentSize()
+{
+#if JUCE_WINDOWS
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return (int64)counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+  #if JUCE_MAC
+    return (int64)usage.ru_maxrss; // bytes
+  #else
+    return (int64)usage.ru_maxrss * 1024; // kilobytes
+  #endif
+#endif
+}
+
+//---------------------------------------------------------
+//   printSummary
+//---------------------------------------------------------
+
+void MemoryStats::printSummary()
+{
+    fprintf(stderr, "\n%-18s %12s %12s %12s\n", "Memory", "Current MB", "Peak MB", "Allocations");
+    
+    for (int i = 0; i < NumCategories; i++)
+    {
+        const Category c = (Category)i;
+        fprintf(stderr, "%-18s %12.1f %12.1f %12lld\n", getCategoryName(c),
+                getCurrent(c) / 1048576.0, getPeak(c) / 1048576.0, (long long)getNumAllocations(c));
+    }
+    
+    fprintf(stderr, "%-18s %12.1f %12.1f\n", "total", getTotalCurrent() / 1048576.0, getTotalPeak() / 1048576.0);
+    fprintf(stderr, "Peak resident size: %.1f MB\n", getPeakResidentSize() / 1048576.0);
+}
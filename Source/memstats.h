@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MEMSTATS_H__
+#define __MEMSTATS_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   MemoryStats
+//---------------------------------------------------------
+
+/** Process-wide accounting of the big allocations made while converting,
+    by category, with current & peak bytes and the number of allocations.
+    Metadata is an estimate of the parsed preset, instrument and sample
+    headers; all other categories are exact. */
+
+class MemoryStats
+{
+public:
+    enum Category
+    {
+        Metadata,       // presets, instruments, zones, sample headers
+        PCM,            // decoded 16 bit sample data
+        Compressed,     // compressed sample data read from a file, encoded payloads
+        CodecScratch,   // temporary buffers of encoders & decoders
+        NumCategories
+    };
+    
+    static void allocated (Category c, int64 bytes);
+    static void freed (Category c, int64 bytes);
+    
+    static int64 getCurrent (Category c)        { return _current[c].get(); }
+    static int64 getPeak (Category c)           { return _peak[c].get(); }
+    static int64 getNumAllocations (Category c) { return _allocations[c].get(); }
+    
+    /** All categories together. The peak is that of the sum, which is
+        usually less than the sum of the peaks. */
+    static int64 getTotalCurrent()              { return _totalCurrent.get(); }
+    static int64 getTotalPeak()                 { return _totalPeak.get(); }
+    
+    /** Lowers all peaks to the current values, to measure the next step alone */
+    static void resetPeaks();
+    
+    /** Peak resident set size of the process as reported by the OS, or 0 */
+    static int64 getPeakResidentSize();
+    
+    static const char* getCategoryName (Category c);
+    static void printSummary();
+
+private:
+    static void updatePeak (Atomic<int64>& peak, int64 value);
+    
+    static Atomic<int64> _current[NumCategories];
+    static Atomic<int64> _peak[NumCategories];
+    static Atomic<int64> _allocations[NumCategories];
+    static Atomic<int64> _totalCurrent;
+    static Atomic<int64> _totalPeak;
+};
+
+//---------------------------------------------------------
+//   ScopedMemoryUse
+//---------------------------------------------------------
+
+/** Accounts for a temporary buffer during the lifetime of this object */
+
+class ScopedMemoryUse
+{
+public:
+    ScopedMemoryUse (MemoryStats::Category c, int64 b) : category(c), bytes(b)
+    {
+        MemoryStats::allocated(category, bytes);
+    }
+   
+   ~ScopedMemoryUse()
+    {
+        MemoryStats::freed(category, bytes);
+    }
+
+private:
+    const MemoryStats::Category category;
+    const int64 bytes;
+    
+    JUCE_DECLARE_NON_COPYABLE (ScopedMemoryUse);
+};
+    
+} // namespace
+
+#endif
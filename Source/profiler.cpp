@@ -0,0 +1,276 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "profiler.h"
+
+#if JUCE_WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace SF2;
+
+bool Profiler::_enabled = false;
+bool Profiler::_tracing = false;
+Profiler::Stats Profiler::_stats[Profiler::NumPhases];
+int64 Profiler::_traceStart = 0;
+Array<Profiler::Span> Profiler::_spans;
+Array<Thread::ThreadID> Profiler::_threadIds;
+StringArray Profiler::_threadNames;
+CriticalSection Profiler::_traceLock;
+
+//---------------------------------------------------------
+//   Profiler
+//---------------------------------------------------------
+
+void Profiler::reset()
+{
+    for (int i = 0; i < NumPhases; i++)
+    {
+        Stats& s = _stats[i];
+        s.calls = 0;
+        s.wallMicros = 0;
+        s.cpuMicros = 0;
+        s.bytesIn = 0;
+        s.bytesOut = 0;
+    }
+}
+
+void Profiler::record (Phase phase, int64 startMicros, int64 wallMicros, int64 cpuMicros,
+                       int64 bytesIn, int64 bytesOut, const String& label)
+{
+    if (_enabled)
+    {
+        Stats& s = _stats[phase];
+        ++s.calls;
+        s.wallMicros += wallMicros;
+        s.cpuMicros += cpuMicros;
+        s.bytesIn += bytesIn;
+        s.bytesOut += bytesOut;
+    }
+    
+    if (_tracing)
+    {
+        Span span;
+        span.phase = phase;
+        span.start = startMicros - _traceStart;
+        span.duration = wallMicros;
+        span.bytesIn = bytesIn;
+        span.bytesOut = bytesOut;
+        span.label = label;
+        
+        const ScopedLock sl (_traceLock);
+        span.thread = getThreadIndex();
+        _spans.add(span);
+    }
+}
+
+const Profiler::Stats& Profiler::getStats (Phase phase)
+{
+    return _stats[phase];
+}
+
+const char* Profiler::getPhaseName (Phase phase)
+{
+    switch (phase)
+    {
+        case Read:              return "read";
+        case ReadHeaders:       return "  headers";
+        case ReadSection:       return "    sections";
+        case ReadSampleRaw:     return "  samples PCM";
+        case ReadSampleVorbis:  return "  samples Vorbis";
+        case ReadSampleFlac:    return "  samples FLAC";
+        case EncodeVorbis:      return "encode Vorbis";
+        case EncodeFlac:        return "encode FLAC";
+        case Write:             return "write";
+        case WriteMetadata:     return "  metadata";
+        case WriteSmpl:         return "  sample data";
+        default:                return "";
+    }
+}
+
+//---------------------------------------------------------
+//   Tracing
+//---------------------------------------------------------
+
+void Profiler::setTracing (bool tracing)
+{
+    const ScopedLock sl (_traceLock);
+    if (tracing && !_tracing)
+    {
+        _traceStart = getWallMicros();
+        _spans.clear();
+        _threadIds.clear();
+        _threadNames.clear();
+    }
+    _tracing = tracing;
+}
+
+/** Small, stable thread numbers make a tidier timeline than native ids.
+    Must be called with _traceLock held. */
+int Profiler::getThreadIndex()
+{
+    const Thread::ThreadID id = Thread::getCurrentThreadId();
+    int index = _threadIds.indexOf(id);
+    if (index < 0)
+    {
+        index = _threadIds.size();
+        _threadIds.add(id);
+        
+        Thread* thread = Thread::getCurrentThread();
+        _threadNames.add(thread != nullptr ? thread->getThreadName() : String("Main"));
+    }
+    return index + 1;
+}
+
+static const char* getCategory (Profiler::Phase phase)
+{
+    switch (phase)
+    {
+        case Profiler::EncodeVorbis:
+        case Profiler::EncodeFlac:      return "encode";
+        case Profiler::Write:
+        case Profiler::WriteMetadata:
+        case Profiler::WriteSmpl:       return "write";
+        default:                        return "read";
+    }
+}
+
+static const char* getLabelKey (Profiler::Phase phase)
+{
+    switch (phase)
+    {
+        case Profiler::ReadHeaders:
+        case Profiler::Write:           return "file";
+        case Profiler::ReadSection:     return "chunk";
+        default:                        return "sample";
+    }
+}
+
+bool Profiler::writeTrace (const File& file)
+{
+    const ScopedLock sl (_traceLock);
+    Array<var> events;
+    
+    for (int i = 0; i < _threadNames.size(); i++)
+    {
+        DynamicObject::Ptr args = new DynamicObject();
+        args->setProperty("name", _threadNames[i]);
+        
+        DynamicObject::Ptr e = new DynamicObject();
+        e->setProperty("name", "thread_name");
+        e->setProperty("ph", "M");
+        e->setProperty("pid", 1);
+        e->setProperty("tid", i + 1);
+        e->setProperty("args", args.get());
+        events.add(e.get());
+    }
+    
+    for (int i = 0; i < _spans.size(); i++)
+    {
+        const Span& span = _spans.getReference(i);
+        
+        DynamicObject::Ptr args = new DynamicObject();
+        if (span.label.isNotEmpty())
+            args->setProperty(getLabelKey(span.phase), span.label);
+        args->setProperty("bytesIn", span.bytesIn);
+        args->setProperty("bytesOut", span.bytesOut);
+        
+        // Complete events, timestamps in microseconds
+        DynamicObject::Ptr e = new DynamicObject();
+        e->setProperty("name", String(getPhaseName(span.phase)).trim());
+        e->setProperty("cat", getCategory(span.phase));
+        e->setProperty("ph", "X");
+        e->setProperty("ts", span.start);
+        e->setProperty("dur", span.duration);
+        e->setProperty("pid", 1);
+        e->setProperty("tid", span.thread);
+        e->setProperty("args", args.get());
+        events.add(e.get());
+    }
+    
+    DynamicObject::Ptr trace = new DynamicObject();
+    trace->setProperty("traceEvents", events);
+    trace->setProperty("displayTimeUnit", "ms");
+    
+    return file.replaceWithText(JSON::toString(var(trace.get()), true) + "\n");
+}
+
+//---------------------------------------------------------
+//   Clocks
+//---------------------------------------------------------
+
+int64 Profiler::getWallMicros()
+{
+    return (int64)(Time::getMillisecondCounterHiRes() * 1000.0);
+}
+
+int64 Profiler::getThreadCpuMicros()
+{
+#if JUCE_WINDOWS
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+        return 0;
+    
+    // 100 ns units
+    const int64 k = ((int64)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    const int64 u = ((int64)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (k + u) / 10;
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    
+    return (int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+//---------------------------------------------------------
+//   printSummary
+//---------------------------------------------------------
+
+void Profiler::printSummary()
+{
+    fprintf(stderr, "\n%-18s %8s %10s %10s %10s %10s %10s\n",
+            "Phase", "Calls", "Wall s", "CPU s", "MB in", "MB out", "MB/s");
+    
+    for (int i = 0; i < NumPhases; i++)
+    {
+        const Phase phase = (Phase)i;
+        const Stats& s = _stats[i];
+        const int64 calls = s.calls.get();
+        if (calls == 0)
+            continue;
+        
+        const double wall = s.wallMicros.get() / 1000000.0;
+        const double cpu  = s.cpuMicros.get() / 1000000.0;
+        const double in   = s.bytesIn.get() / 1048576.0;
+        const double out  = s.bytesOut.get() / 1048576.0;
+        const double rate = wall > 0 ? jmax(in, out) / wall : 0.0;
+        
+        fprintf(stderr, "%-18s %8lld %10.3f %10.3f %10.1f %10.1f %10.1f\n",
+                getPhaseName(phase), (long long)calls, wall, cpu, in, out, rate);
+    }
+}
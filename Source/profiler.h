@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   Profiler
+//---------------------------------------------------------
+
+/** Process-wide timing and throughput counters per conversion phase. Phases
+    nest, e.g. ReadSection is part of ReadHeaders, and every phase counts its
+    nested ones, too. Samples are processed on several threads at once, so
+    phase times add up across threads and may exceed the elapsed time.
+    
+    Optionally, every single call is recorded as a span with its thread,
+    sample name and byte counts, to be viewed as a timeline in a trace viewer
+    like chrome://tracing or Perfetto. */
+
+class Profiler
+{
+public:
+    enum Phase
+    {
+        Read,
+        ReadHeaders,
+        ReadSection,
+        ReadSampleRaw,
+        ReadSampleVorbis,
+        ReadSampleFlac,
+        EncodeVorbis,
+        EncodeFlac,
+        Write,
+        WriteMetadata,
+        WriteSmpl,
+        NumPhases
+    };
+    
+    struct Stats
+    {
+        Atomic<int64> calls;
+        Atomic<int64> wallMicros;
+        Atomic<int64> cpuMicros;
+        Atomic<int64> bytesIn;
+        Atomic<int64> bytesOut;
+    };
+    
+    /** Disabled by default, in which case scopes cost a single branch */
+    static void setEnabled (bool enabled)   { _enabled = enabled; }
+    static bool isEnabled()                 { return _enabled; }
+    
+    /** Records spans for writeTrace(), independent of setEnabled() */
+    static void setTracing (bool tracing);
+    static bool isTracing()                 { return _tracing; }
+    static bool isActive()                  { return _enabled || _tracing; }
+    
+    static void reset();
+    static void record (Phase phase, int64 startMicros, int64 wallMicros, int64 cpuMicros,
+                        int64 bytesIn, int64 bytesOut, const String& label);
+    static const Stats& getStats (Phase phase);
+    static const char* getPhaseName (Phase phase);
+    
+    /** Prints one line per phase that occurred: calls, wall & CPU seconds,
+        megabytes in & out, and throughput of the larger of the two */
+    static void printSummary();
+    
+    /** Writes all spans recorded so far in Trace Event Format (JSON) */
+    static bool writeTrace (const File& file);
+    
+    static int64 getWallMicros();
+    
+    /** CPU time consumed by the calling thread so far */
+    static int64 getThreadCpuMicros();
+
+private:
+    struct Span
+    {
+        Phase phase;
+        int thread;
+        int64 start;
+        int64 duration;
+        int64 bytesIn;
+        int64 bytesOut;
+        String label;
+    };
+    
+    static int getThreadIndex();
+    
+    static bool _enabled;
+    static bool _tracing;
+    static Stats _stats[NumPhases];
+    static int64 _traceStart;
+    static Array<Span> _spans;
+    static Array<Thread::ThreadID> _threadIds;
+    static StringArray _threadNames;
+    static CriticalSection _traceLock;
+};
+
+//---------------------------------------------------------
+//   ProfileScope
+//---------------------------------------------------------
+
+/** Measures the enclosing block as one call of a phase */
+
+class ProfileScope
+{
+public:
+    ProfileScope (Profiler::Phase p) :
+        phase(p),
+        active(Profiler::isActive()),
+        wallStart(0),
+        cpuStart(0),
+        bytesIn(0),
+        bytesOut(0)
+    {
+        if (active)
+        {
+            wallStart = Profiler::getWallMicros();
+            cpuStart = Profiler::getThreadCpuMicros();
+        }
+    }
+   
+   ~ProfileScope()
+    {
+        if (active)
+            Profiler::record(phase, wallStart,
+                             Profiler::getWallMicros() - wallStart,
+                             Profiler::getThreadCpuMicros() - cpuStart,
+                             bytesIn, bytesOut, label);
+    }
+    
+    void addBytesIn (int64 n)   { bytesIn += n; }
+    void addBytesOut (int64 n)  { bytesOut += n; }
+    
+    /** Tags the span in a trace, e.g. with a sample name */
+    void setLabel (const String& l)
+    {
+        if (active)
+            label = l;
+    }
+
+private:
+    const Profiler::Phase phase;
+    const bool active;
+    int64 wallStart;
+    int64 cpuStart;
+    int64 bytesIn;
+    int64 bytesOut;
+    String label;
+    
+    JUCE_DECLARE_NON_COPYABLE (ProfileScope);
+};
+    
+} // namespace
+
+#endif
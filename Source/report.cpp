@@ -0,0 +1,223 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "report.h"
+#include "batch.h"
+#include "memstats.h"
+
+using namespace SF2;
+
+//---------------------------------------------------------
+//   describeFile
+//---------------------------------------------------------
+
+var ConversionReport::describeFile (const BatchItem& item, const SoundFont& font, const OwnedArray<Encoding>& encodings)
+{
+    DynamicObject::Ptr file = new DynamicObject();
+    file->setProperty("input", item.input.getFullPathName());
+    file->setProperty("format", item.input.getFileExtension().substring(1).toLowerCase());
+    file->setProperty("size", item.sizeIn);
+    
+    // Outputs, along with their share of the encoding time
+    Array<var> outputs;
+    double encodeSeconds = 0, writeSeconds = 0;
+    
+    for (int o = 0; o < item.outputs.size(); o++)
+    {
+        const BatchOutput* out = item.outputs.getUnchecked(o);
+        double seconds = 0;
+        if (const Encoding* e = encodings[o])
+            for (int i = 0; i < e->seconds.size(); i++)
+                seconds += e->seconds.getUnchecked(i);
+        
+        DynamicObject::Ptr output = new DynamicObject();
+        output->setProperty("file", out->file.getFullPathName());
+        output->setProperty("format", getFormatName(out->format));
+        output->setProperty("quality", out->quality);
+        output->setProperty("codec", font.getEncoderSetting(out->format, out->quality));
+        output->setProperty("size", out->size);
+        output->setProperty("ratio", item.sizeIn > 0 ? (double)out->size / (double)item.sizeIn : 0.0);
+        output->setProperty("cached", out->cached);
+        output->setProperty("encodeSeconds", seconds);
+        output->setProperty("writeSeconds", out->writeSeconds);
+        outputs.add(output.get());
+        
+        encodeSeconds += seconds;
+        writeSeconds += out->writeSeconds;
+    }
+    file->setProperty("outputs", outputs);
+    
+    // Samples with one entry per encoded output
+    Array<var> samples;
+    double decodeSeconds = 0;
+    
+    for (int i = 0; i < font.getNumSamples(); i++)
+    {
+        const Sample* s = font.getSample(i);
+        decodeSeconds += s->decodeSeconds;
+        
+        DynamicObject::Ptr sample = new DynamicObject();
+        sample->setProperty("name", s->name);
+        sample->setProperty("rawBytes", s->isLoaded() ? (int64)s->numSamples() * (int64)sizeof(short) : (int64)0);
+        sample->setProperty("storedBytes", s->storedBytes);
+        sample->setProperty("decodeSeconds", s->decodeSeconds);
+        sample->setProperty("verification", getVerification(s));
+        
+        Array<var> encoded;
+        for (int o = 0; o < encodings.size(); o++)
+        {
+            const Encoding* e = encodings.getUnchecked(o);
+            const MemoryBlock* payload = e->payloads[i];
+            if (payload == nullptr)
+                continue;
+            
+            DynamicObject::Ptr entry = new DynamicObject();
+            entry->setProperty("output", o);
+            entry->setProperty("codec", font.getEncoderSetting(e->format, e->quality));
+            entry->setProperty("quality", e->quality);
+            entry->setProperty("bytes", (int64)payload->getSize());
+            entry->setProperty("seconds", e->seconds[i]);
+            encoded.add(entry.get());
+        }
+        sample->setProperty("encoded", encoded);
+        samples.add(sample.get());
+    }
+    file->setProperty("samples", samples);
+    
+    DynamicObject::Ptr phases = new DynamicObject();
+    phases->setProperty("parse", item.parseSeconds);
+    phases->setProperty("decode", decodeSeconds);
+    phases->setProperty("encode", encodeSeconds);
+    phases->setProperty("write", writeSeconds);
+    file->setProperty("phases", phases.get());
+    
+    return file.get();
+}
+
+//---------------------------------------------------------
+//   describeBatch
+//---------------------------------------------------------
+
+var ConversionReport::describeBatch (const BatchConverter& batch)
+{
+    Array<var> files;
+    int64 sizeIn = 0, sizeOut = 0;
+    int failed = 0;
+    
+    for (int i = 0; i < batch.getNumItems(); i++)
+    {
+        const BatchItem* item = batch.getItem(i);
+        
+        // Without BatchConverter::setReportEnabled(), only the outcome is known
+        var file = item->report;
+        if (!file.isObject())
+        {
+            DynamicObject::Ptr empty = new DynamicObject();
+            empty->setProperty("input", item->input.getFullPathName());
+            empty->setProperty("size", item->sizeIn);
+            file = empty.get();
+        }
+        
+        DynamicObject* d = file.getDynamicObject();
+        d->setProperty("ok", item->ok);
+        d->setProperty("error", item->error);
+        d->setProperty("sizeOut", item->sizeOut);
+        d->setProperty("seconds", item->seconds);
+        files.add(file);
+        
+        if (item->ok)
+        {
+            sizeIn  += item->sizeIn;
+            sizeOut += item->sizeOut;
+        }
+        else
+            failed++;
+    }
+    
+    DynamicObject::Ptr totals = new DynamicObject();
+    totals->setProperty("files", batch.getNumItems());
+    totals->setProperty("failed", failed);
+    totals->setProperty("sizeIn", sizeIn);
+    totals->setProperty("sizeOut", sizeOut);
+    totals->setProperty("seconds", batch.getSeconds());
+    
+    // Peak bytes per category, see MemoryStats
+    DynamicObject::Ptr memory = new DynamicObject();
+    for (int i = 0; i < MemoryStats::NumCategories; i++)
+    {
+        const MemoryStats::Category c = (MemoryStats::Category)i;
+        DynamicObject::Ptr category = new DynamicObject();
+        category->setProperty("peak", MemoryStats::getPeak(c));
+        category->setProperty("allocations", MemoryStats::getNumAllocations(c));
+        memory->setProperty(MemoryStats::getCategoryName(c), category.get());
+    }
+    memory->setProperty("totalPeak", MemoryStats::getTotalPeak());
+    memory->setProperty("peakResidentSize", MemoryStats::getPeakResidentSize());
+    
+    DynamicObject::Ptr report = new DynamicObject();
+    report->setProperty("tool", ProjectInfo::projectName);
+    report->setProperty("version", ProjectInfo::versionString);
+    report->setProperty("totals", totals.get());
+    report->setProperty("memory", memory.get());
+    report->setProperty("files", files);
+    return report.get();
+}
+
+//---------------------------------------------------------
+//   write
+//---------------------------------------------------------
+
+bool ConversionReport::write (const var& report, const String& path, const File& cwd)
+{
+    const String json = JSON::toString(report);
+    
+    if (path == "-")
+    {
+        fprintf(stdout, "%s\n", json.toRawUTF8());
+        fflush(stdout);
+        return true;
+    }
+    
+    return cwd.getChildFile(path).replaceWithText(json + "\n");
+}
+
+//---------------------------------------------------------
+//   helpers
+//---------------------------------------------------------
+
+String ConversionReport::getFormatName (FileType format)
+{
+    return BatchConverter::getFileExtension(format);
+}
+
+/** Compressed files carry the original sample lengths & loops, which
+    tells whether decompression restored them properly */
+String ConversionReport::getVerification (const Sample* s)
+{
+    if (!s->isLoaded())
+        return "not loaded";
+    if (s->meta == nullptr)
+        return "none";
+    return s->checkMeta() ? "passed" : "failed";
+}
@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "sfont.h"
+
+namespace SF2 {
+
+class BatchItem;
+class BatchConverter;
+
+//---------------------------------------------------------
+//   ConversionReport
+//---------------------------------------------------------
+
+/** Machine-readable account of a conversion, as JSON. Per file it lists
+    sizes, phase timings and all outputs, and per sample its raw & compressed
+    sizes, encoder setting, encode & decode times and verification result.
+    Times of decoding and encoding are summed over samples, which are
+    processed concurrently, so these may exceed the total time. */
+
+class ConversionReport
+{
+public:
+    /** Describes one file while its samples & payloads are still around */
+    static var describeFile (const BatchItem& item, const SoundFont& font, const OwnedArray<Encoding>& encodings);
+    
+    /** Collects all file descriptions of a batch that has run */
+    static var describeBatch (const BatchConverter& batch);
+    
+    /** Writes to a file, or to stdout if the path is "-" */
+    static bool write (const var& report, const String& path, const File& cwd);
+
+private:
+    static String getFormatName (FileType format);
+    static String getVerification (const Sample* s);
+};
+    
+} // namespace
+
+#endif
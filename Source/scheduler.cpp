@@ -0,0 +1,204 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scheduler.h"
+
+using namespace SF2;
+
+/** Orders queues by ascending cost, so the most expensive task is last */
+struct TaskCostComparator
+{
+    static int compareElements (const Task* a, const Task* b)
+    {
+        const int64 ca = a->getCost();
+        const int64 cb = b->getCost();
+        return (ca < cb) ? -1 : ((cb < ca) ? 1 : 0);
+    }
+};
+
+//---------------------------------------------------------
+//   Worker
+//---------------------------------------------------------
+
+class Scheduler::Worker : public Thread
+{
+public:
+    Worker (Scheduler& s, int i) :
+        Thread ("Scheduler Worker " + String(i)),
+        scheduler(s),
+        index(i)
+    {
+    }
+    
+   ~Worker()
+    {
+        for (int i = 0; i < queue.size(); i++)
+            delete queue.getUnchecked(i);
+    }
+    
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            Task* task = scheduler.take(index);
+            
+            if (task != nullptr)
+                scheduler.execute(task);
+            else
+                scheduler._workAvailable.wait(20);
+        }
+    }
+    
+    void push (Task* task)
+    {
+        TaskCostComparator comparator;
+        const ScopedLock sl (lock);
+        queue.addSorted(comparator, task);
+    }
+    
+    Task* popMostExpensive()
+    {
+        const ScopedLock sl (lock);
+        return queue.isEmpty() ? nullptr : queue.removeAndReturn(queue.size() - 1);
+    }
+    
+    int64 getMostExpensiveCost()
+    {
+        const ScopedLock sl (lock);
+        return queue.isEmpty() ? -1 : queue.getLast()->getCost();
+    }
+    
+    Scheduler& scheduler;
+    const int index;
+    
+private:
+    CriticalSection lock;
+    Array<Task*> queue;
+    
+    JUCE_DECLARE_NON_COPYABLE (Worker);
+};
+
+//---------------------------------------------------------
+//   Scheduler
+//---------------------------------------------------------
+
+Scheduler::Scheduler (int numThreads) :
+    _pending(0),
+    _nextQueue(0),
+    _workAvailable(),
+    _idle()
+{
+    if (numThreads <= 0)
+        numThreads = SystemStats::getNumCpus();
+    
+    for (int i = 0; i < numThreads; i++)
+        _workers.add(new Worker(*this, i));
+    
+    for (int i = 0; i < _workers.size(); i++)
+        _workers.getUnchecked(i)->startThread();
+}
+
+Scheduler::~Scheduler()
+{
+    for (int i = 0; i < _workers.size(); i++)
+        _workers.getUnchecked(i)->signalThreadShouldExit();
+    
+    for (int i = 0; i < _workers.size(); i++)
+        _workers.getUnchecked(i)->stopThread(10000);
+    
+    // Deletes any tasks left over
+    _workers.clear();
+}
+
+//---------------------------------------------------------
+//   add
+//---------------------------------------------------------
+
+void Scheduler::add (Task* task)
+{
+    jassert (task != nullptr);
+    
+    ++_pending;
+    
+    // Spawned by one of our workers: keep it local, others may steal it
+    Worker* worker = dynamic_cast<Worker*> (Thread::getCurrentThread());
+    if (worker == nullptr || &worker->scheduler != this)
+        worker = _workers.getUnchecked((++_nextQueue & 0x7fffffff) % _workers.size());
+    
+    worker->push(task);
+    _workAvailable.signal();
+}
+
+//---------------------------------------------------------
+//   take
+//---------------------------------------------------------
+
+Task* Scheduler::take (int workerIndex)
+{
+    Task* task = _workers.getUnchecked(workerIndex)->popMostExpensive();
+    return (task != nullptr) ? task : steal(workerIndex);
+}
+
+Task* Scheduler::steal (int thiefIndex)
+{
+    // Look for the most expensive task queued anywhere. This is racy, but
+    // losing the race merely means trying again on the next round.
+    Worker* victim = nullptr;
+    int64 maxCost = -1;
+    
+    for (int i = 1; i < _workers.size(); i++)
+    {
+        Worker* w = _workers.getUnchecked((thiefIndex + i) % _workers.size());
+        int64 cost = w->getMostExpensiveCost();
+        if (cost > maxCost)
+        {
+            maxCost = cost;
+            victim = w;
+        }
+    }
+    return (victim != nullptr) ? victim->popMostExpensive() : nullptr;
+}
+
+//---------------------------------------------------------
+//   execute
+//---------------------------------------------------------
+
+void Scheduler::execute (Task* task)
+{
+    task->run(*this);
+    delete task;
+    
+    if (--_pending == 0)
+        _idle.signal();
+}
+
+//---------------------------------------------------------
+//   waitUntilIdle
+//---------------------------------------------------------
+
+void Scheduler::waitUntilIdle()
+{
+    while (_pending.get() > 0)
+        _idle.wait(50);
+}
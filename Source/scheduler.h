@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+namespace SF2 {
+
+class Scheduler;
+
+//---------------------------------------------------------
+//   Task
+//---------------------------------------------------------
+
+/** A unit of work run by the Scheduler. Tasks may add further tasks
+    while running, e.g. a file parser spawns one task per sample. */
+
+class Task
+{
+public:
+    Task() {};
+    virtual ~Task() {};
+    
+    /** Estimated amount of work, e.g. bytes to process. Tasks with the
+        highest cost are started first, which keeps the long tail short. */
+    virtual int64 getCost() const = 0;
+    
+    virtual void run (Scheduler& scheduler) = 0;
+};
+
+//---------------------------------------------------------
+//   Scheduler
+//---------------------------------------------------------
+
+/** Work-stealing thread pool. Every worker has its own queue, ordered by
+    task cost. Tasks added by a worker go to its own queue; a worker that
+    runs dry steals the most expensive task queued by any other worker. */
+
+class Scheduler
+{
+public:
+    /** Zero threads means one per CPU */
+    Scheduler (int numThreads = 0);
+   ~Scheduler();
+    
+    /** Takes ownership of the task. Safe to call from any thread. */
+    void add (Task* task);
+    
+    /** Blocks until all tasks, including those spawned by other tasks, have finished */
+    void waitUntilIdle();
+    
+    int getNumThreads() const   { return _workers.size(); }
+    
+private:
+    class Worker;
+    
+    Task* take (int workerIndex);
+    Task* steal (int thiefIndex);
+    void execute (Task* task);
+    
+    OwnedArray<Worker> _workers;
+    Atomic<int> _pending;
+    Atomic<int> _nextQueue;
+    WaitableEvent _workAvailable;
+    WaitableEvent _idle;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Scheduler);
+};
+    
+} // namespace
+
+#endif
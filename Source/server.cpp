@@ -0,0 +1,370 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "server.h"
+#include "batch.h"
+
+#if ! JUCE_WINDOWS
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+
+using namespace SF2;
+
+static const size_t maxRequestLength = 65536;
+static const int receiveTimeoutSeconds = 30;
+
+#if ! JUCE_WINDOWS
+
+//---------------------------------------------------------
+//   Socket helpers
+//---------------------------------------------------------
+
+static bool makeAddress (const File& socketFile, sockaddr_un& address)
+{
+    const String path = socketFile.getFullPathName();
+    zerostruct(address);
+    address.sun_family = AF_UNIX;
+    
+    if (path.getNumBytesAsUTF8() >= sizeof(address.sun_path))
+        return false;
+    
+    strcpy(address.sun_path, path.toRawUTF8());
+    return true;
+}
+
+/** Works on sockets and pipes alike. On pipes, SIGPIPE must be ignored. */
+static bool sendAll (int fd, const String& text)
+{
+  #ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+  #else
+    const int flags = 0;
+  #endif
+    const char* data = text.toRawUTF8();
+    size_t remaining = strlen(data);
+    
+    while (remaining > 0)
+    {
+        ssize_t n = ::send(fd, data, remaining, flags);
+        if (n < 0 && errno == ENOTSOCK)
+            n = ::write(fd, data, remaining);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        remaining -= (size_t)n;
+    }
+    return true;
+}
+
+/** Reads up to the next newline, keeping whatever follows in the buffer.
+    Fails at the end of the stream, on timeout, or if the line is too long. */
+static bool readLine (int fd, MemoryBlock& buffer, String& line)
+{
+    for (;;)
+    {
+        const char* data = (const char*)buffer.getData();
+        for (size_t i = 0; i < buffer.getSize(); i++)
+        {
+            if (data[i] == '\n')
+            {
+                line = String::fromUTF8(data, (int)i).trimCharactersAtEnd("\r");
+                buffer.removeSection(0, i + 1);
+                return true;
+            }
+        }
+        
+        if (buffer.getSize() > maxRequestLength)
+            return false;
+        
+        char chunk[4096];
+        const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buffer.append(chunk, (size_t)n);
+    }
+}
+
+#endif
+
+/** Responses are single lines of TAB separated fields */
+static String sanitize (const String& message)
+{
+    return message.replaceCharacters("\t\r\n", "   ");
+}
+
+//---------------------------------------------------------
+//   ConversionServer
+//---------------------------------------------------------
+
+ConversionServer::ConversionServer (const File& socketFile, int numThreads) :
+    _socketFile(socketFile),
+    _prune(false),
+    _index(false),
+    _verbose(false),
+    _stopping(false),
+    _socket(-1),
+    _scheduler(numThreads)
+{
+}
+
+ConversionServer::~ConversionServer()
+{
+#if ! JUCE_WINDOWS
+    if (_socket >= 0)
+    {
+        ::close(_socket);
+        _socketFile.deleteFile();
+    }
+#endif
+}
+
+bool ConversionServer::isSupported()
+{
+#if JUCE_WINDOWS
+    return false;
+#else
+    return true;
+#endif
+}
+
+//---------------------------------------------------------
+//   start
+//---------------------------------------------------------
+
+bool ConversionServer::start()
+{
+#if JUCE_WINDOWS
+    fprintf(stderr, "Server mode requires UNIX domain sockets, which are not available on Windows\n");
+    return false;
+#else
+    const String fullPath = _socketFile.getFullPathName();
+    const char* path = fullPath.toRawUTF8();
+    sockaddr_un address;
+    if (!makeAddress(_socketFile, address))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return false;
+    }
+    
+    // A socket left behind by a crashed server is replaced, one in use is not
+    if (_socketFile.exists())
+    {
+        if (ConversionClient::send(_socketFile, "ping").startsWith("ok"))
+        {
+            fprintf(stderr, "A server is already listening on %s\n", path);
+            return false;
+        }
+        _socketFile.deleteFile();
+    }
+    
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::bind(fd, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, 64) != 0)
+    {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    _socket = fd;
+    
+    // Clients hanging up early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+#endif
+}
+
+//---------------------------------------------------------
+//   run
+//---------------------------------------------------------
+
+void ConversionServer::run()
+{
+#if ! JUCE_WINDOWS
+    fprintf(stderr, "Listening on %s with %d workers\n",
+            _socketFile.getFullPathName().toRawUTF8(), _scheduler.getNumThreads());
+    
+    while (!_stopping)
+    {
+        const int connection = ::accept(_socket, nullptr, nullptr);
+        if (connection < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Accepting connection failed: %s\n", strerror(errno));
+            break;
+        }
+        
+        // Connections are served one at a time, so a stalled client
+        // is dropped after a while rather than blocking all others
+        timeval timeout;
+        timeout.tv_sec = receiveTimeoutSeconds;
+        timeout.tv_usec = 0;
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        
+        serve(connection, connection);
+        ::close(connection);
+    }
+#endif
+}
+
+void ConversionServer::runOnStandardStreams()
+{
+#if ! JUCE_WINDOWS
+    // The coordinator going away just ends this worker
+    signal(SIGPIPE, SIG_IGN);
+    serve(STDIN_FILENO, STDOUT_FILENO);
+#endif
+}
+
+void ConversionServer::serve (int input, int output)
+{
+#if ! JUCE_WINDOWS
+    MemoryBlock buffer;
+    String request;
+    while (!_stopping && readLine(input, buffer, request))
+    {
+        if (request.isEmpty())
+            continue;
+        if (!sendAll(output, handle(request) + "\n"))
+            break;
+    }
+#else
+    ignoreUnused(input, output);
+#endif
+}
+
+String ConversionServer::handle (const String& request)
+{
+    StringArray fields;
+    fields.addTokens(request, "\t", "");
+    const String command = fields[0];
+    
+    if (command == "ping")
+        return "ok\t" + String(ProjectInfo::versionString);
+    
+    if (command == "stop")
+    {
+        _stopping = true;
+        return "ok";
+    }
+    
+    if (command == "convert")
+        return convert(fields);
+    
+    return "error\tunknown request: " + sanitize(command);
+}
+
+//---------------------------------------------------------
+//   convert
+//---------------------------------------------------------
+
+String ConversionServer::convert (const StringArray& fields)
+{
+    if (fields.size() < 3)
+        return "error\texpected: convert TAB infile TAB spec [TAB spec ...]";
+    
+    // The server's working directory means nothing to clients
+    if (!File::isAbsolutePath(fields[1]))
+        return "error\tpath must be absolute: " + sanitize(fields[1]);
+    
+    BatchConverter converter (SF2Format, 2);
+    converter.setVerbose(_verbose);
+    converter.setSampleLayout(_layout);
+    converter.setPruneEnabled(_prune);
+    converter.setIndexEnabled(_index);
+    if (_cacheDirectory != File())
+        converter.setCacheDirectory(_cacheDirectory);
+    
+    BatchItem* item = converter.addFile(File(fields[1]));
+    for (int i = 2; i < fields.size(); i++)
+    {
+        FileType format;
+        int quality;
+        String path;
+        if (!BatchConverter::parseOutputSpec(fields[i], format, quality, path))
+            return "error\tinvalid output spec: " + sanitize(fields[i]);
+        if (!File::isAbsolutePath(path))
+            return "error\tpath must be absolute: " + sanitize(path);
+        
+        item->addOutput(File(path), format, quality);
+    }
+    
+    if (_verbose)
+        fprintf(stderr, "Converting %s\n", fields[1].toRawUTF8());
+    
+    converter.run(_scheduler);
+    
+    if (!item->ok)
+        return "error\t" + sanitize(item->error.isNotEmpty() ? item->error : String("conversion failed"));
+    
+    String response;
+    response << "ok\t" << item->sizeIn << "\t" << item->sizeOut << "\t" << String(item->seconds, 3)
+             << "\t" << item->getNumCached();
+    return response;
+}
+
+//---------------------------------------------------------
+//   ConversionClient
+//---------------------------------------------------------
+
+String ConversionClient::send (const File& socketFile, const String& request)
+{
+#if JUCE_WINDOWS
+    ignoreUnused(socketFile, request);
+    return String();
+#else
+    sockaddr_un address;
+    if (!makeAddress(socketFile, address))
+        return String();
+    
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return String();
+    
+    String response;
+    if (::connect(fd, (const sockaddr*)&address, sizeof(address)) == 0 && sendAll(fd, request + "\n"))
+    {
+        MemoryBlock buffer;
+        if (!readLine(fd, buffer, response))
+            response = String();
+    }
+    ::close(fd);
+    return response;
+#endif
+}
+
+File ConversionClient::getDefaultSocket()
+{
+    const String path = SystemStats::getEnvironmentVariable("SF2CONVERT_SERVER", String());
+    return File::isAbsolutePath(path) ? File(path) : File();
+}
@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "sfont.h"
+#include "scheduler.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   ConversionServer
+//---------------------------------------------------------
+
+/** Converts files on behalf of other processes, listening on a UNIX domain
+    socket. The process and its worker threads stay up between jobs, so
+    clients save the startup cost. Jobs run one after another, each of them
+    spread across all workers.
+    
+    The protocol is one request per line, fields separated by TAB, and one
+    response line per request:
+        
+        convert TAB infile TAB spec [TAB spec ...]
+            spec is format[:quality]:outfile as for --out, paths absolute
+            -> ok TAB sizeIn TAB sizeOut TAB seconds TAB cached outputs
+        ping    -> ok TAB version
+        stop    -> ok, then the server exits
+    
+    Failures are answered with: error TAB message */
+
+class ConversionServer
+{
+public:
+    ConversionServer (const File& socketFile, int numThreads);
+   ~ConversionServer();
+    
+    void setCacheDirectory (const File& directory)  { _cacheDirectory = directory; }
+    void setSampleLayout (const SampleLayout& layout)  { _layout = layout; }
+    void setPruneEnabled (bool enabled)             { _prune = enabled; }
+    void setIndexEnabled (bool enabled)             { _index = enabled; }
+    void setVerbose (bool verbose)                  { _verbose = verbose; }
+    
+    /** Binds the socket. Fails if another server is listening on it already. */
+    bool start();
+    
+    /** Serves connections until a stop request */
+    void run();
+    
+    /** Serves requests on stdin, answering on stdout, until stdin is closed.
+        This is how the worker processes of a ShardedBatch run. */
+    void runOnStandardStreams();
+    
+    static bool isSupported();
+
+private:
+    void serve (int input, int output);
+    String handle (const String& request);
+    String convert (const StringArray& fields);
+    
+    File _socketFile;
+    File _cacheDirectory;
+    SampleLayout _layout;
+    bool _prune;
+    bool _index;
+    bool _verbose;
+    bool _stopping;
+    int _socket;
+    Scheduler _scheduler;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ConversionServer);
+};
+
+//---------------------------------------------------------
+//   ConversionClient
+//---------------------------------------------------------
+
+/** Hands requests to a running ConversionServer */
+
+class ConversionClient
+{
+public:
+    /** Returns the response line, or an empty string if no server answers */
+    static String send (const File& socketFile, const String& request);
+    
+    /** Socket named by the environment variable SF2CONVERT_SERVER, if any */
+    static File getDefaultSocket();
+};
+    
+} // namespace
+
+#endif
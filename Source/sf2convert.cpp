@@ -24,6 +24,17 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "sfont.h"
+#include "batch.h"
+#include "report.h"
+#include "profiler.h"
+#include "memstats.h"
+#include "bench.h"
+#include "analysis.h"
+#include "server.h"
+#include "shard.h"
+#include "watch.h"
+#include "bake.h"
+#include "index.h"
 
 //---------------------------------------------------------
 //   usage
@@ -33,6 +44,13 @@ static void usage(const char* pname)
 {
     fprintf(stderr, "sf2convert - SoundFont Compression Utility, 2017 Cognitone\n");
     fprintf(stderr, "usage: %s [-flags] infile outfile\n", pname);
+    fprintf(stderr, "       %s [-flags] infile --out spec [--out spec ...]\n", pname);
+    fprintf(stderr, "       %s [-flags] --batch indir|manifest outdir\n", pname);
+    fprintf(stderr, "       %s [-flags] --watch [--settle ms] indir outdir\n", pname);
+    fprintf(stderr, "       %s --analyze [--subset N] infile\n", pname);
+    fprintf(stderr, "       %s --bake outfile infile\n", pname);
+    fprintf(stderr, "       %s --serve socket [--jobs N] [--cache dir]\n", pname);
+    fprintf(stderr, "       %s bench [bench options]\n", pname);
     fprintf(stderr, "flags:\n");
     fprintf(stderr, "   -zf    compress source file using FLAC (SF4 format)\n");
     fprintf(stderr, "   -zf0   ditto w/quality=low\n");
@@ -46,6 +64,200 @@ static void usage(const char* pname)
     
     fprintf(stderr, "   -x     expand source file to SF2 format\n");
     fprintf(stderr, "   -d     dump presets\n");
+    
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "   --align N    start each sample's data at a multiple of N bytes in the output,\n");
+    fprintf(stderr, "                e.g. 4096 for page aligned or direct I/O (power of two)\n");
+    fprintf(stderr, "   --analyze    project size, encode & decode time and SNR of every Vorbis\n");
+    fprintf(stderr, "                and FLAC option from a subset of the samples\n");
+    fprintf(stderr, "   --bake f     write a baked font to file f: presets resolved for playback & raw\n");
+    fprintf(stderr, "                PCM, for memory mapping by players. Not portable across CPUs\n");
+    fprintf(stderr, "   --batch      convert all SoundFonts in a directory tree, or listed in a\n");
+    fprintf(stderr, "                manifest file (infile [TAB outfile] per line)\n");
+    fprintf(stderr, "   --cache dir  reuse outputs of earlier runs with identical input & settings,\n");
+    fprintf(stderr, "                storing new ones in dir\n");
+    fprintf(stderr, "   --heads N    SF2 output: also store the first N frames of every sample together\n");
+    fprintf(stderr, "                in front of all sample data, for players preloading heads\n");
+    fprintf(stderr, "   --index      read headers from a sidecar index next to each input (.idx),\n");
+    fprintf(stderr, "                written on first use and whenever the input changes\n");
+    fprintf(stderr, "   --jobs N     number of worker threads (default: all CPUs)\n");
+    fprintf(stderr, "   --mem        print current & peak memory per category (metadata, PCM,\n");
+    fprintf(stderr, "                compressed data, codec scratch) and peak resident size\n");
+    fprintf(stderr, "   --out spec   additional output as format[:quality]:outfile, e.g. sf3:0:low.sf3\n");
+    fprintf(stderr, "                (format sf2, sf3 or sf4). All outputs share one read & decode\n");
+    fprintf(stderr, "   --preset-order  store the samples of each preset together in the output,\n");
+    fprintf(stderr, "                presets by bank & program, so loading one reads a single range\n");
+    fprintf(stderr, "   --presets l  keep only these presets, listed as bank:program, e.g. 0:0,0:25,128:0,\n");
+    fprintf(stderr, "                with the instruments & samples they use. Only those are decoded\n");
+    fprintf(stderr, "   --processes N  with --batch, convert in N worker processes, so a file crashing\n");
+    fprintf(stderr, "                the converter fails alone. Crashed workers are restarted\n");
+    fprintf(stderr, "   --profile    print where the time goes: wall & CPU time, bytes and\n");
+    fprintf(stderr, "                throughput per phase of reading, encoding and writing\n");
+    fprintf(stderr, "   --prune      drop instruments no preset uses & samples no instrument uses,\n");
+    fprintf(stderr, "                listed (--verbose in batch mode). They are neither decoded nor written\n");
+    fprintf(stderr, "   --trace f    write a timeline of all reads, encodes and writes per thread\n");
+    fprintf(stderr, "                to file f, for viewing in chrome://tracing or Perfetto\n");
+    fprintf(stderr, "   --report f   write a JSON report with per-sample statistics to file f,\n");
+    fprintf(stderr, "                or to stdout if f is -\n");
+    fprintf(stderr, "   --queue N    with --watch, maximum number of files per round (default 64)\n");
+    fprintf(stderr, "   --retries N  times a file is retried after crashing a worker process before\n");
+    fprintf(stderr, "                it is quarantined (default 1)\n");
+    fprintf(stderr, "   --serve s    keep running and convert files for other processes, listening\n");
+    fprintf(stderr, "                on UNIX socket s\n");
+    fprintf(stderr, "   --server s   hand single file conversions to a server on socket s, if one\n");
+    fprintf(stderr, "                is running (default: $SF2CONVERT_SERVER)\n");
+    fprintf(stderr, "   --settle ms  with --watch, time a file must be left unchanged before it is\n");
+    fprintf(stderr, "                converted (default 2000)\n");
+    fprintf(stderr, "   --subset N   number of samples to analyze (default 32)\n");
+    fprintf(stderr, "   --timeout s  with --processes, seconds a worker may take for one file before\n");
+    fprintf(stderr, "                it is killed, counting as a crash (default 1800, 0 for none)\n");
+    fprintf(stderr, "   --verbose    log every sample, also in batch mode\n");
+    fprintf(stderr, "   --watch      keep converting new & changed SoundFonts in indir into outdir,\n");
+    fprintf(stderr, "                until interrupted\n");
+    
+    fprintf(stderr, "bench options:\n");
+    fprintf(stderr, "   --samples N      number of samples in the synthetic bank (default 64)\n");
+    fprintf(stderr, "   --length min:max sample lengths in frames (default 4096:65536)\n");
+    fprintf(stderr, "   --stereo r       share of samples in stereo pairs, 0..1 (default 0.25)\n");
+    fprintf(stderr, "   --zones N        zones per instrument (default 4)\n");
+    fprintf(stderr, "   --generators N   generators per zone (default 8)\n");
+    fprintf(stderr, "   --seed N         seed of the generator, same seed gives the same bank\n");
+    fprintf(stderr, "   --report f       write results as JSON to file f, or to stdout if f is -\n");
+    fprintf(stderr, "   --check f        run the fixed regression banks and compare with baseline f,\n");
+    fprintf(stderr, "                    failing on slowdowns, more allocations or memory, lower SNR\n");
+    fprintf(stderr, "   --save-baseline f  run the regression banks and save the results to file f\n");
+    fprintf(stderr, "   --repeat N       run N times and keep the fastest (default 1, regression 3)\n");
+    fprintf(stderr, "   --tolerance p    allowed slowdown in percent (default 25)\n");
+    fprintf(stderr, "   --profile, --mem, --trace f  as above\n");
+}
+
+//---------------------------------------------------------
+//   finishProfiling
+//---------------------------------------------------------
+
+static void finishProfiling(bool profile, bool memory, const String& tracePath, const File& cwd)
+{
+    if (profile)
+        SF2::Profiler::printSummary();
+    
+    if (memory)
+        SF2::MemoryStats::printSummary();
+    
+    if (tracePath.isNotEmpty() && !SF2::Profiler::writeTrace(cwd.getChildFile(tracePath)))
+        fprintf(stderr, "Error writing trace %s\n", tracePath.toRawUTF8());
+}
+
+//---------------------------------------------------------
+//   bench
+//---------------------------------------------------------
+
+/** Times read, encode, write and decode of a synthetic bank for every
+    codec & quality, on a single thread so results compare across machines */
+static int bench(int argc, char* argv[])
+{
+    SF2::SyntheticBank::Options options;
+    bool profile = false;
+    bool memory = false;
+    int repeats = 0;
+    SF2::RegressionSuite::Tolerances tolerances;
+    String reportPath;
+    String tracePath;
+    String baselinePath;
+    String savePath;
+    
+    for (int i = 2; i < argc; i++)
+    {
+        const String token (argv[i]);
+        const bool hasValue = i + 1 < argc;
+        
+        if (token == "--profile")
+            profile = true;
+        else if (token == "--mem")
+            memory = true;
+        else if (token == "--samples" && hasValue)
+            options.numSamples = String(argv[++i]).getIntValue();
+        else if (token == "--length" && hasValue)
+        {
+            const String range (argv[++i]);
+            options.minLength = range.upToFirstOccurrenceOf(":", false, false).getIntValue();
+            options.maxLength = range.containsChar(':') ? range.fromFirstOccurrenceOf(":", false, false).getIntValue() : options.minLength;
+        }
+        else if (token == "--stereo" && hasValue)
+            options.stereoRatio = String(argv[++i]).getDoubleValue();
+        else if (token == "--zones" && hasValue)
+            options.zonesPerInstrument = String(argv[++i]).getIntValue();
+        else if (token == "--generators" && hasValue)
+            options.generatorsPerZone = String(argv[++i]).getIntValue();
+        else if (token == "--seed" && hasValue)
+            options.seed = String(argv[++i]).getLargeIntValue();
+        else if (token == "--report" && hasValue)
+            reportPath = argv[++i];
+        else if (token == "--trace" && hasValue)
+            tracePath = argv[++i];
+        else if (token == "--check" && hasValue)
+            baselinePath = argv[++i];
+        else if (token == "--save-baseline" && hasValue)
+            savePath = argv[++i];
+        else if (token == "--repeat" && hasValue)
+            repeats = String(argv[++i]).getIntValue();
+        else if (token == "--tolerance" && hasValue)
+            tolerances.time = String(argv[++i]).getDoubleValue() / 100.0;
+        else
+        {
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    
+    SF2::Profiler::setEnabled(profile);
+    SF2::Profiler::setTracing(tracePath.isNotEmpty());
+    const File cwd = File::getCurrentWorkingDirectory();
+    
+    // Regression mode ignores the bank options, so that runs compare
+    if (baselinePath.isNotEmpty() || savePath.isNotEmpty())
+    {
+        var baseline;
+        if (baselinePath.isNotEmpty())
+        {
+            baseline = JSON::parse(cwd.getChildFile(baselinePath));
+            if (!baseline.isObject())
+            {
+                fprintf(stderr, "Cannot read baseline %s\n", baselinePath.toRawUTF8());
+                return 3;
+            }
+        }
+        
+        SF2::RegressionSuite suite;
+        const bool ok = suite.run(repeats > 0 ? repeats : 3);
+        suite.printSummary();
+        finishProfiling(profile, memory, tracePath, cwd);
+        
+        const var results = suite.getResults();
+        if (reportPath.isNotEmpty() && !SF2::ConversionReport::write(results, reportPath, cwd))
+            fprintf(stderr, "Error writing report %s\n", reportPath.toRawUTF8());
+        
+        if (savePath.isNotEmpty() && !SF2::ConversionReport::write(results, savePath, cwd))
+            fprintf(stderr, "Error writing baseline %s\n", savePath.toRawUTF8());
+        
+        if (!ok)
+        {
+            fprintf(stderr, "\n*** VERIFICATION FAILED ***\n");
+            return 5;
+        }
+        if (baselinePath.isNotEmpty() && suite.compare(baseline, tolerances) > 0)
+            return 6;
+        return 0;
+    }
+    
+    SF2::Benchmark benchmark (options);
+    const bool ok = benchmark.run(jmax(1, repeats));
+    benchmark.printSummary();
+    finishProfiling(profile, memory, tracePath, cwd);
+    
+    if (reportPath.isNotEmpty() && !SF2::ConversionReport::write(benchmark.getResults(), reportPath, cwd))
+        fprintf(stderr, "Error writing report %s\n", reportPath.toRawUTF8());
+    
+    return ok ? 0 : 5;
 }
 
 //---------------------------------------------------------
@@ -58,43 +270,129 @@ int main(int argc, char* argv[])
     bool convert = false;
     SF2::FileType format = SF2::SF2Format;
     int  quality = 2;
-    bool any = false;
+    bool batch = false;
+    bool verbose = false;
+    bool profile = false;
+    bool memory = false;
+    bool analyze = false;
+    bool worker = false;
+    bool watch = false;
+    bool useIndex = false;
+    bool prune = false;
+    int  settleTime = 2000;
+    int  maxQueue = 64;
+    int  jobs = 0;
+    int  processes = 0;
+    int  retries = 1;
+    int  timeout = 1800;
+    SF2::SampleLayout layout;
+    int  subsetSize = 32;
+    String cacheDir;
+    String reportPath;
+    String tracePath;
+    String servePath;
+    String bakePath;
+    String presetList;
+    File serverSocket = SF2::ConversionClient::getDefaultSocket();
+    
+    const char* pname = argv[0];
+    if (argc > 1 && String(argv[1]) == "bench")
+        return bench(argc, argv);
+    
+    StringArray args;
+    StringArray outputs;
     
-    StringArray commandLine (argv + 1, argc - 1);
-    /** Lacking getopt() on Windows, this is a quick & simple hack to pasre command line options */
-    while (commandLine.size() > 2)
+    /** Lacking getopt() on Windows, this is a quick & simple hack to parse command line options */
+    for (int i = 1; i < argc; i++)
     {
-        String token = commandLine.getReference(0);
-        if (token.startsWith("-"))
+        String token (argv[i]);
+        if (token.startsWith("--"))
+        {
+            if (token == "--batch")
+                batch = true;
+            else if (token == "--verbose")
+                verbose = true;
+            else if (token == "--profile")
+                profile = true;
+            else if (token == "--mem")
+                memory = true;
+            else if (token == "--analyze")
+                analyze = true;
+            else if (token == "--subset" && i + 1 < argc)
+                subsetSize = String(argv[++i]).getIntValue();
+            else if (token == "--jobs" && i + 1 < argc)
+                jobs = String(argv[++i]).getIntValue();
+            else if (token == "--cache" && i + 1 < argc)
+                cacheDir = argv[++i];
+            else if (token == "--trace" && i + 1 < argc)
+                tracePath = argv[++i];
+            else if (token == "--report" && i + 1 < argc)
+                reportPath = argv[++i];
+            else if (token == "--processes" && i + 1 < argc)
+                processes = String(argv[++i]).getIntValue();
+            else if (token == "--retries" && i + 1 < argc)
+                retries = String(argv[++i]).getIntValue();
+            else if (token == "--timeout" && i + 1 < argc)
+                timeout = jmax(0, String(argv[++i]).getIntValue());
+            else if (token == "--align" && i + 1 < argc)
+                layout.alignment = String(argv[++i]).getIntValue();
+            else if (token == "--heads" && i + 1 < argc)
+                layout.headFrames = jmax(0, String(argv[++i]).getIntValue());
+            else if (token == "--preset-order")
+                layout.byPreset = true;
+            else if (token == "--presets" && i + 1 < argc)
+                presetList = argv[++i];
+            else if (token == "--prune")
+                prune = true;
+            else if (token == "--index")
+                useIndex = true;
+            else if (token == "--watch")
+                watch = true;
+            else if (token == "--settle" && i + 1 < argc)
+                settleTime = String(argv[++i]).getIntValue();
+            else if (token == "--queue" && i + 1 < argc)
+                maxQueue = String(argv[++i]).getIntValue();
+            else if (token == "--worker")
+                worker = true;
+            else if (token == "--serve" && i + 1 < argc)
+                servePath = argv[++i];
+            else if (token == "--server" && i + 1 < argc)
+                serverSocket = File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+            else if (token == "--bake" && i + 1 < argc)
+                bakePath = argv[++i];
+            else if (token == "--out" && i + 1 < argc)
+                outputs.add(argv[++i]);
+            else
+            {
+                usage(pname);
+                exit(1);
+            }
+        }
+        else if (token.startsWith("-"))
         {
             if (token.indexOfChar('x') > 0)
             {
                 convert = true;
                 format = SF2::SF2Format;
-                any = true;
             }
             if (token.indexOfChar('z') > 0)
             {
                 convert = true;
                 format = SF2::SF3Format;
-                any = true;
             }
             if (token.indexOfChar('o') > 0)
             {
                 convert = true;
                 format = SF2::SF3Format;
-                any = true;
             }
             if (token.indexOfChar('f') > 0)
             {
                 convert = true;
                 format = SF2::SF4Format;
-                any = true;
             }
             if (token.indexOfChar('d') > 0)
             {
                 dump = true;
-                any = true;
             }
             if (token.indexOfChar('0') > 0)
             {
@@ -109,26 +407,312 @@ int main(int argc, char* argv[])
                 quality = 2;
             }
             //DBG(token);
-            commandLine.remove(0);
         }
+        else
+            args.add(token);
     }
     
-    const char* pname = argv[0];
-
-    if (commandLine.size() != 2 && !any)
+    // Offsets of SF2 samples count 16 bit frames, so at least 2
+    if (layout.alignment != 0 && (layout.alignment < 2 || !isPowerOfTwo(layout.alignment)))
+    {
+        fprintf(stderr, "Alignment must be a power of two: %d\n", layout.alignment);
+        exit(1);
+    }
+    
+    // A bank:program list means little across many different banks
+    if (presetList.isNotEmpty() && (batch || watch || worker || servePath.isNotEmpty()))
+    {
+        fprintf(stderr, "--presets applies to single file conversions only\n");
+        exit(1);
+    }
+    
+    if (bakePath.isNotEmpty() && (batch || watch || worker || servePath.isNotEmpty()))
+    {
+        fprintf(stderr, "--bake applies to single files only\n");
+        exit(1);
+    }
+    
+    // Forwarded conversions must come out as they would locally, clients
+    // asking for a different output convert by themselves
+    if (servePath.isNotEmpty() && (layout.getDescription().isNotEmpty() || prune))
+    {
+        fprintf(stderr, "--serve can't be combined with options changing the output (--align, --heads, --preset-order, --prune)\n");
+        exit(1);
+    }
+    
+    // Started by a sharded batch, see SF2::ShardedBatch
+    if (worker)
+    {
+        SF2::ConversionServer server (File(), jobs);
+        server.setVerbose(verbose);
+        server.setSampleLayout(layout);
+        server.setPruneEnabled(prune);
+        server.setIndexEnabled(useIndex);
+        if (cacheDir.isNotEmpty())
+            server.setCacheDirectory(File::getCurrentWorkingDirectory().getChildFile(cacheDir));
+        
+        server.runOnStandardStreams();
+        return 0;
+    }
+    
+    if (servePath.isNotEmpty())
+    {
+        SF2::ConversionServer server (File::getCurrentWorkingDirectory().getChildFile(servePath), jobs);
+        server.setVerbose(verbose);
+        server.setSampleLayout(layout);
+        server.setPruneEnabled(prune);
+        server.setIndexEnabled(useIndex);
+        if (cacheDir.isNotEmpty())
+            server.setCacheDirectory(File::getCurrentWorkingDirectory().getChildFile(cacheDir));
+        
+        if (!server.start())
+            return(3);
+        
+        server.run();
+        return 0;
+    }
+    
+    const bool dumpOnly = dump && !convert && !batch;
+    const bool outputsOnly = outputs.size() > 0 && !batch;
+    const bool analyzeOnly = analyze && !batch;
+    const bool bakeOnly = bakePath.isNotEmpty() && !batch && !convert;
+    if (args.size() != 2 && !((dumpOnly || outputsOnly || analyzeOnly || bakeOnly) && args.size() == 1))
     {
         usage(pname);
         exit(1);
     }
     
-    File inFilename (commandLine[0]);
-    File outFilename (commandLine[1]);
+    SF2::Profiler::setEnabled(profile);
+    SF2::Profiler::setTracing(tracePath.isNotEmpty());
+    
+    const File cwd = File::getCurrentWorkingDirectory();
+    File inFilename  = cwd.getChildFile(args[0]);
+    File outFilename = cwd.getChildFile(args[1]);
+
+    if (analyzeOnly)
+    {
+        SF2::SoundFont sf(inFilename);
+        sf.setVerbose(verbose);
+        
+        if (!sf.readHeaders()) {
+            fprintf(stderr, "Error reading file\n");
+            return(3);
+        }
+        
+        SF2::CodecAnalysis analysis (sf, subsetSize);
+        if (!analysis.run(jobs)) {
+            fprintf(stderr, "Error analyzing file\n");
+            return(3);
+        }
+        analysis.printMatrix();
+        finishProfiling(profile, memory, tracePath, cwd);
+        
+        if (reportPath.isNotEmpty() && !SF2::ConversionReport::write(analysis.getResults(), reportPath, cwd))
+            fprintf(stderr, "Error writing report %s\n", reportPath.toRawUTF8());
+        return 0;
+    }
+    
+    if (bakePath.isNotEmpty() && !batch)
+    {
+        SF2::SoundFont sf(inFilename);
+        sf.setVerbose(verbose);
+        
+        if (!sf.readHeaders()) {
+            fprintf(stderr, "Error reading file\n");
+            return(3);
+        }
+        
+        if (presetList.isNotEmpty() && !sf.selectPresets(presetList)) {
+            fprintf(stderr, "Error selecting presets\n");
+            return(3);
+        }
+        
+        if (prune && !sf.prune()) {
+            fprintf(stderr, "Error pruning file\n");
+            return(3);
+        }
+        
+        SF2::BakedWriter writer (sf);
+        const File bakeFile = cwd.getChildFile(bakePath);
+        sf.log("Baking " + bakeFile.getFullPathName());
+        if (!writer.write(bakeFile)) {
+            fprintf(stderr, "Error baking file: %s\n", writer.getLastError().toRawUTF8());
+            return(4);
+        }
+        
+        if (!convert && outputs.size() == 0) {
+            finishProfiling(profile, memory, tracePath, cwd);
+            return 0;
+        }
+    }
+    
+    if (watch)
+    {
+        SF2::WatchService service (inFilename, outFilename, format, quality, jobs);
+        service.setVerbose(verbose);
+        service.setSampleLayout(layout);
+        service.setPruneEnabled(prune);
+        service.setIndexEnabled(useIndex);
+        service.setSettleTime(settleTime);
+        service.setMaxQueue(jmax(1, maxQueue));
+        if (cacheDir.isNotEmpty())
+            service.setCacheDirectory(cwd.getChildFile(cacheDir));
+        
+        if (!service.start())
+            return(3);
+        
+        service.run();
+        return 0;
+    }
+    
+    if (batch)
+    {
+        SF2::BatchConverter converter (format, quality);
+        converter.setVerbose(verbose);
+        if (cacheDir.isNotEmpty())
+            converter.setCacheDirectory(cwd.getChildFile(cacheDir));
+        converter.setReportEnabled(reportPath.isNotEmpty());
+        converter.setIndexEnabled(useIndex);
+        converter.setSampleLayout(layout);
+        converter.setPruneEnabled(prune);
+        
+        if (inFilename.isDirectory())
+            converter.addDirectory(inFilename, outFilename);
+        else if (inFilename.existsAsFile())
+            converter.addManifest(inFilename, outFilename);
+        
+        if (converter.getNumItems() == 0)
+        {
+            fprintf(stderr, "No SoundFonts found in %s\n", inFilename.getFullPathName().toRawUTF8());
+            return(3);
+        }
+        
+        int failed;
+        if (processes > 0)
+        {
+            // The threads are shared out among the processes
+            const int threads = jobs > 0 ? jobs : SystemStats::getNumCpus();
+            SF2::ShardedBatch sharded (converter, processes, threads / processes);
+            sharded.setVerbose(verbose);
+            sharded.setMaxRetries(retries);
+            sharded.setTimeout(timeout);
+            if (cacheDir.isNotEmpty())
+                sharded.setCacheDirectory(cwd.getChildFile(cacheDir));
+            
+            failed = sharded.run();
+            sharded.printSummary();
+        }
+        else
+        {
+            failed = converter.run(jobs);
+            converter.printSummary();
+        }
+        finishProfiling(profile, memory, tracePath, cwd);
+        
+        if (reportPath.isNotEmpty() && !SF2::ConversionReport::write(SF2::ConversionReport::describeBatch(converter), reportPath, cwd))
+            fprintf(stderr, "Error writing report %s\n", reportPath.toRawUTF8());
+        
+        return failed > 0 ? 4 : 0;
+    }
+
+    // A single file conversion is a batch of one, which spreads the
+    // samples across all CPU cores
+    if ((convert || outputs.size() > 0) && !dump)
+    {
+        // Checked first, so forwarded and local runs fail alike
+        for (int i = 0; i < outputs.size(); i++)
+        {
+            SF2::FileType f;
+            int q;
+            String path;
+            if (!SF2::BatchConverter::parseOutputSpec(outputs[i], f, q, path))
+            {
+                fprintf(stderr, "Invalid output spec: %s\n", outputs[i].toRawUTF8());
+                usage(pname);
+                exit(1);
+            }
+        }
+        
+        // A running server does the same work without the startup cost,
+        // unless something only this process can measure or set was asked for
+        const bool localOnly = profile || memory || reportPath.isNotEmpty() || tracePath.isNotEmpty()
+                             || layout.getDescription().isNotEmpty() || presetList.isNotEmpty() || prune || useIndex
+                             || cacheDir.isNotEmpty();
+        if (serverSocket != File() && !localOnly)
+        {
+            String request;
+            request << "convert\t" << inFilename.getFullPathName();
+            if (args.size() == 2)
+                request << "\t" << SF2::BatchConverter::getFileExtension(format) << ":" << quality << ":" << outFilename.getFullPathName();
+            
+            for (int i = 0; i < outputs.size(); i++)
+            {
+                SF2::FileType f;
+                int q;
+                String path;
+                SF2::BatchConverter::parseOutputSpec(outputs[i], f, q, path);
+                request << "\t" << SF2::BatchConverter::getFileExtension(f) << ":" << q << ":" << cwd.getChildFile(path).getFullPathName();
+            }
+            
+            // No answer means no server, so convert right here
+            const String response = SF2::ConversionClient::send(serverSocket, request);
+            if (response.startsWith("ok"))
+                return 0;
+            if (response.startsWith("error"))
+            {
+                fprintf(stderr, "Error converting file: %s\n", response.fromFirstOccurrenceOf("\t", false, false).toRawUTF8());
+                return(4);
+            }
+        }
+        
+        SF2::BatchConverter converter (format, quality);
+        converter.setVerbose(true);
+        if (cacheDir.isNotEmpty())
+            converter.setCacheDirectory(cwd.getChildFile(cacheDir));
+        converter.setReportEnabled(reportPath.isNotEmpty());
+        converter.setIndexEnabled(useIndex);
+        converter.setSampleLayout(layout);
+        converter.setPresetSelection(presetList);
+        converter.setPruneEnabled(prune);
+        SF2::BatchItem* item = converter.addFile(inFilename);
+        
+        if (args.size() == 2)
+            item->addOutput(outFilename, format, quality);
+        
+        for (int i = 0; i < outputs.size(); i++)
+        {
+            SF2::FileType f;
+            int q;
+            String path;
+            SF2::BatchConverter::parseOutputSpec(outputs[i], f, q, path);
+            item->addOutput(cwd.getChildFile(path), f, q);
+        }
+        
+        const int failed = converter.run(jobs);
+        finishProfiling(profile, memory, tracePath, cwd);
+        
+        if (reportPath.isNotEmpty() && !SF2::ConversionReport::write(SF2::ConversionReport::describeBatch(converter), reportPath, cwd))
+            fprintf(stderr, "Error writing report %s\n", reportPath.toRawUTF8());
+        
+        if (failed > 0) {
+            fprintf(stderr, "Error converting file\n");
+            return(4);
+        }
+        return 0;
+    }
 
     {
         SF2::SoundFont sf(inFilename);
         sf.log("Reading " + inFilename.getFullPathName());
+        if (useIndex)
+            sf.setIndexFile(SF2::FontIndex::getSidecarFile(inFilename));
         
-        if (!sf.read()) {
+        // With a selection or pruning, only the samples kept are loaded, when written
+        const bool ok = presetList.isEmpty() && !prune ? sf.read()
+                      : (sf.readHeaders()
+                         && (presetList.isEmpty() || sf.selectPresets(presetList))
+                         && (!prune || sf.prune()));
+        if (!ok) {
             fprintf(stderr, "Error reading file\n");
             return(3);
         }
@@ -139,9 +723,14 @@ int main(int argc, char* argv[])
         if (convert)
         {
             sf.log("Writing " + outFilename.getFullPathName());
-            sf.write (outFilename, format, quality);
+            SF2::Encoding encoding (format, quality, sf.getNumSamples());
+            encoding.layout = layout;
+            if (!sf.write (outFilename, encoding)) {
+                fprintf(stderr, "Error writing file\n");
+                return(4);
+            }
         }
     }
+    finishProfiling(profile, memory, tracePath, cwd);
     return 0;
 }
-
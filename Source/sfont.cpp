@@ -23,6 +23,9 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "sfont.h"
+#include "profiler.h"
+#include "memstats.h"
+#include "index.h"
 
 #if ! USE_JUCE_VORBIS
 #include "juce_audio_formats/codecs/oggvorbis/codec.h"
@@ -55,7 +58,10 @@ Sample::Sample() :
     byteData(nullptr),
     sampleDataSize(0),
     sampleData(nullptr),
-    meta()
+    meta(),
+    loadState(NotLoaded),
+    storedBytes(0),
+    decodeSeconds(0)
 {
     // All members are required to be all-zero, for a clean Sample instance is used as terminator in shdr chunk!
 }
@@ -66,16 +72,38 @@ Sample::~Sample()
     dropByteData();
 }
 
+void Sample::allocateSampleData (int numSamples)
+{
+    dropSampleData();
+    sampleData = new short[numSamples];
+    sampleDataSize = numSamples;
+    MemoryStats::allocated(MemoryStats::PCM, numSamples * sizeof(short));
+}
+
+void Sample::allocateByteData (int numBytes)
+{
+    dropByteData();
+    byteData = new byte[numBytes];
+    byteDataSize = numBytes;
+    MemoryStats::allocated(MemoryStats::Compressed, numBytes);
+}
+
 void Sample::dropByteData()
 {
-    free(byteData);
+    if (byteData != nullptr)
+        MemoryStats::freed(MemoryStats::Compressed, byteDataSize);
+    
+    delete[] byteData;
     byteData = nullptr;
     byteDataSize = 0;
 }
 
 void Sample::dropSampleData()
 {
-    free(sampleData);
+    if (sampleData != nullptr)
+        MemoryStats::freed(MemoryStats::PCM, sampleDataSize * sizeof(short));
+    
+    delete[] sampleData;
     sampleData = nullptr;
     sampleDataSize = 0;
 }
@@ -89,16 +117,24 @@ SampleCompression Sample::getCompressionType()
 
 void Sample::setCompressionType (SampleCompression c)
 {
+    sampletype = withCompressionType(sampletype, c);
+}
+
+int Sample::withCompressionType (int type, SampleCompression c)
+{
+    type &= ~((int)(SampleType::TypeVorbis + SampleType::TypeFlac));
     switch (c)
     {
         case SampleCompression::Vorbis :
+            type |= SampleType::TypeVorbis;
+            break;
         case SampleCompression::Flac :
-            sampletype |= (int)c;
+            type |= SampleType::TypeFlac;
             break;
         case SampleCompression::Raw :
-            sampletype &= ~((int)(SampleType::TypeVorbis + SampleType::TypeFlac));
             break;
     }
+    return type;
 }
 
 /** 
@@ -133,7 +169,7 @@ SampleMeta* Sample::createMeta()
 /** 
  Verify if sample was properly restored after decompression.
  */
-bool Sample::checkMeta()
+bool Sample::checkMeta() const
 {
     if (meta == nullptr)
         return true;
@@ -142,11 +178,170 @@ bool Sample::checkMeta()
         && (meta->loopend - meta->loopstart) == (loopend - loopstart);
 }
 
+bool Sample::isLoaded() const
+{
+    return loadState.get() == Loaded;
+}
+
+
+//---------------------------------------------------------
+//   SampleLayout
+//---------------------------------------------------------
+
+String SampleLayout::getDescription() const
+{
+    StringArray parts;
+    if (alignment > 0)
+        parts.add("align " + String(alignment));
+    if (byPreset)
+        parts.add("by preset");
+    if (headFrames > 0)
+        parts.add("heads " + String(headFrames));
+    return parts.joinIntoString(", ");
+}
+
+//---------------------------------------------------------
+//   Encoding
+//---------------------------------------------------------
+
+Encoding::Encoding (FileType f, int q, int numSamples) :
+    format(f),
+    quality(q)
+{
+    for (int i = 0; i < numSamples; i++)
+        payloads.add(nullptr);
+    
+    seconds.insertMultiple(0, 0.0, numSamples);
+}
+
+Encoding::~Encoding()
+{
+    for (int i = 0; i < payloads.size(); i++)
+        if (const MemoryBlock* payload = payloads.getUnchecked(i))
+            MemoryStats::freed(MemoryStats::Compressed, payload->getSize());
+    
+    payloads.clear();
+}
+
+
+//---------------------------------------------------------
+//   CodecRegistry
+//---------------------------------------------------------
+
+static CriticalSection codecRegistryLock;
+static Atomic<CodecRegistry*> codecRegistry;
+
+/** Thread-safe function statics can't be relied upon with all compilers
+    this builds with, so creation is guarded explicitly. A static object,
+    rather than a heap one, is destroyed at exit before the leak detectors
+    check. */
+const CodecRegistry& CodecRegistry::getInstance()
+{
+    if (CodecRegistry* registry = codecRegistry.get())
+        return *registry;
+    
+    const ScopedLock sl (codecRegistryLock);
+    static CodecRegistry instance;
+    codecRegistry.set(&instance);
+    return instance;
+}
+
+/** Only the two formats needed, not every basic format */
+CodecRegistry::CodecRegistry() :
+    vorbis(new OggVorbisAudioFormat()),
+    flac(new FlacAudioFormat())
+{
+    vorbisOptions = vorbis->getQualityOptions();
+    flacOptions   = flac->getQualityOptions();
+    
+    /** DEBUG: Use this snippet to learn about quality options */
+    /*
+    for (int i=0; i < vorbisOptions.size(); i++)
+        DBG ("Vorbis " + String(i) + ": " + vorbisOptions[i]);
+    for (int i=0; i < flacOptions.size(); i++)
+        DBG ("FLAC " + String(i) + ": " + flacOptions[i]);
+    */
+}
+
+AudioFormat* CodecRegistry::getFormat (FileType format) const
+{
+    switch (format)
+    {
+        case SF3Format: return vorbis;
+        case SF4Format: return flac;
+        default:        return nullptr;
+    }
+}
+
+const StringArray& CodecRegistry::getQualityOptions (FileType format) const
+{
+    switch (format)
+    {
+        case SF3Format: return vorbisOptions;
+        case SF4Format: return flacOptions;
+        default:        return none;
+    }
+}
+
 
 //---------------------------------------------------------
 //   SoundFont
 //---------------------------------------------------------
 
+/** Background thread of readAsync(): parses headers first, then
+    decodes samples in file order, unless cancelled. */
+
+class SoundFont::Loader : public Thread
+{
+public:
+    Loader (SoundFont& f, LoadListener* l) :
+        Thread ("SoundFont Loader"),
+        font(f),
+        listener(l)
+    {
+    }
+    
+    void run() override
+    {
+        bool ok = font.readHeaders();
+        
+        if (ok && listener != nullptr)
+            listener->presetsAvailable(&font);
+        
+        for (int i = 0; ok && i < font._samples.size(); i++)
+        {
+            if (threadShouldExit() || font._cancel->isCancelled())
+            {
+                font.error("Loading cancelled: " + font._path.getFileName());
+                ok = false;
+                break;
+            }
+            ok = font.loadSample(i);
+            
+            if (ok && listener != nullptr)
+            {
+                listener->sampleLoaded(&font, i);
+                listener->loadProgress(&font, font.getReadProgress());
+            }
+        }
+        
+        if (ok)
+        {
+            font.closeInput();
+            font.updateIndex();
+        }
+        
+        if (listener != nullptr)
+            listener->loadFinished(&font, ok);
+    }
+    
+private:
+    SoundFont& font;
+    LoadListener* listener;
+    
+    JUCE_DECLARE_NON_COPYABLE (Loader);
+};
+
 SoundFont::SoundFont (const File filename) :
     _path(filename),
     _engine(),
@@ -157,40 +352,39 @@ SoundFont::SoundFont (const File filename) :
     _creator(),
     _product(),
     _copyright(),
-    _infile(nullptr),
+    _samplePos(0),
+    _sampleLen(0),
+    _metadataSize(0),
+    _infile(),
     _outfile(nullptr),
     _fileFormatIn(SF2Format),
     _fileFormatOut(SF2Format),
     _fileSizeIn(0),
     _fileSizeOut(0),
-    _manager()
+    _verbose(true),
+    _readFromIndex(false),
+    _indexComplete(false),
+    _bytesLoaded(0)
 {
-    _manager.registerBasicFormats();
-    _audioFormatVorbis = dynamic_cast<OggVorbisAudioFormat*> (_manager.findFormatForFileExtension("ogg"));
-    _audioFormatFlac   = dynamic_cast<FlacAudioFormat*> (_manager.findFormatForFileExtension("flac"));
-    
-    jassert (_audioFormatVorbis != nullptr);
-    jassert (_audioFormatFlac != nullptr);
-    
-    _qualityOptionsVorbis = _audioFormatVorbis->getQualityOptions();
-    _qualityOptionsFlac   = _audioFormatFlac->getQualityOptions();
-    
-    /** DEBUG: Use this snippet to learn about quality options */
-    /*
-    log("Vorbis");
-    for (int i=0; i < _qualityOptionsVorbis.size(); i++)
-        log (String(i) + ": " + _qualityOptionsVorbis[i]);
-    log("FLAC");
-    for (int i=0; i < _qualityOptionsFlac.size(); i++)
-        log (String(i) + ": " + _qualityOptionsFlac[i]);
-    */
+}
+
+SoundFont::SoundFont (InputStream* input) :
+    SoundFont (File())
+{
+    _infile = input;
+    _fileSizeIn = input->getTotalLength();
 }
 
 SoundFont::~SoundFont()
 {
-    _manager.clearFormats();
-    _qualityOptionsVorbis.clear();
-    _qualityOptionsFlac.clear();
+    // A background load must not outlive its font
+    cancelRead();
+    if (_loader != nullptr)
+        _loader->stopThread(10000);
+    _loader = nullptr;
+    
+    MemoryStats::freed(MemoryStats::Metadata, _metadataSize);
+    
     _samples.clear();
     _instruments.clear();
     _presets.clear();
@@ -212,14 +406,54 @@ SoundFont::~SoundFont()
 
 bool SoundFont::read()
 {
-    _fileSizeIn = _path.getSize();
-    ScopedPointer<FileInputStream> in = new FileInputStream(_path);
-    _infile = in;
+    ProfileScope scope (Profiler::Read);
     
-    if (!_infile->openedOk()) {
-        log(String("cannot open " + _path.getFullPathName()));
+    if (!readHeaders())
         return false;
+    
+    // load sample data
+    for (int i = 0; i < _samples.size(); i++)
+        if (!loadSample(i))
+            return false;
+    
+    closeInput();
+    updateIndex();
+    scope.addBytesIn(_fileSizeIn);
+    return true;
+}
+
+//---------------------------------------------------------
+//   readHeaders
+//---------------------------------------------------------
+
+bool SoundFont::readHeaders()
+{
+    ProfileScope scope (Profiler::ReadHeaders);
+    scope.setLabel(_path.getFileName());
+    
+    // Unless reading from a stream handed to the constructor
+    if (_infile == nullptr)
+    {
+        FileInputStream* in = new FileInputStream(_path);
+        _infile = in;
+        _fileSizeIn = _path.getSize();
+        
+        if (!in->openedOk()) {
+            error(String("cannot open " + _path.getFullPathName()));
+            return false;
+        }
+    }
+    
+    if (_indexFile != File() && FontIndex::load(*this, _indexFile))
+    {
+        log("Headers read from index " + _indexFile.getFullPathName());
+        _readFromIndex = true;
+        _indexComplete = !_sampleHashes.contains(0);
+        _metadataSize = estimateMetadataSize();
+        MemoryStats::allocated(MemoryStats::Metadata, _metadataSize);
+        return true;
     }
+    
     try {
         int len = readFourcc("RIFF");
         readSignature("sfbk");
@@ -240,21 +474,199 @@ bool SoundFont::read()
                 readSection(fourcc, len3);
             }
         }
-        // load sample data
-        for (int i = 0; i < _samples.size(); i++)
-            readSampleData(_samples[i]);
     }
     catch (juce::String s) {
-        log(s);
+        error(s);
         return false;
     }
     catch (const char* s) {
-        log(String(s));
+        error(String(s));
+        return false;
+    }
+    
+    for (int i = 0; i < _samples.size(); i++)
+    {
+        Sample* s = _samples.getUnchecked(i);
+        _headersIn.add(SampleHeader(s, s->getCompressionType()));
+    }
+    
+    // Not worth failing the read for
+    if (_indexFile != File() && _path != File() && !FontIndex::save(*this, _indexFile))
+        log("Cannot write index " + _indexFile.getFullPathName());
+    
+    _metadataSize = estimateMetadataSize();
+    MemoryStats::allocated(MemoryStats::Metadata, _metadataSize);
+    return true;
+}
+
+//---------------------------------------------------------
+//   estimateMetadataSize
+//---------------------------------------------------------
+
+/** Rough size of all parsed headers, ignoring strings & allocator overhead */
+int64 SoundFont::estimateMetadataSize() const
+{
+    int64 size = _presets.size() * (int64)sizeof(Preset)
+               + _instruments.size() * (int64)sizeof(Instrument)
+               + _samples.size() * (int64)(sizeof(Sample) + sizeof(SampleMeta));
+    
+    const Array<Zone*>* zoneLists[] = { &_pZones, &_iZones };
+    for (int l = 0; l < 2; l++)
+    {
+        for (int i = 0; i < zoneLists[l]->size(); i++)
+        {
+            const Zone* z = zoneLists[l]->getUnchecked(i);
+            size += sizeof(Zone)
+                  + z->generators.size() * (int64)sizeof(GeneratorList)
+                  + z->modulators.size() * (int64)sizeof(ModulatorList);
+        }
+    }
+    return size;
+}
+
+//---------------------------------------------------------
+//   readAsync
+//---------------------------------------------------------
+
+bool SoundFont::readAsync (LoadListener* listener, CancellationToken::Ptr token)
+{
+    if (_loader != nullptr)
+        return false; // only once per instance
+    
+    _cancel = token;
+    if (_cancel == nullptr)
+        _cancel = new CancellationToken();
+    _loader = new Loader(*this, listener);
+    _loader->startThread();
+    return true;
+}
+
+void SoundFont::cancelRead()
+{
+    if (_cancel != nullptr)
+        _cancel->cancel();
+}
+
+bool SoundFont::waitForReadToFinish (int timeoutMs)
+{
+    if (_loader != nullptr && !_loader->waitForThreadToExit(timeoutMs))
+        return false;
+    
+    return isLoaded();
+}
+
+double SoundFont::getReadProgress() const
+{
+    if (_sampleLen <= 0)
+        return isLoaded() ? 1.0 : 0.0;
+    
+    return jmin(1.0, (double)_bytesLoaded.get() / (double)_sampleLen);
+}
+
+bool SoundFont::isLoaded() const
+{
+    for (int i = 0; i < _samples.size(); i++)
+        if (!_samples.getUnchecked(i)->isLoaded())
+            return false;
+    
+    return true;
+}
+
+//---------------------------------------------------------
+//   loadSample
+//---------------------------------------------------------
+
+bool SoundFont::loadSample (int index)
+{
+    Sample* s = _samples[index];
+    if (s == nullptr)
+        return false;
+    
+    // Somebody else is already at it, or it's done
+    if (!s->loadState.compareAndSetBool(Sample::Loading, Sample::NotLoaded))
+        return waitForSample(index);
+    
+    bool ok = true;
+    const double started = Time::getMillisecondCounterHiRes();
+    try {
+        s->storedBytes = readSampleData(s);
+        _bytesLoaded += s->storedBytes;
+    }
+    catch (juce::String e) {
+        error(e);
+        ok = false;
+    }
+    catch (const char* e) {
+        error(String(e));
+        ok = false;
+    }
+    
+    // A stale index that still matched the file would show here
+    jassert (!ok || _sampleHashes[index] == 0 || _sampleHashes[index] == FontIndex::hashSample(s));
+    
+    s->decodeSeconds = (Time::getMillisecondCounterHiRes() - started) / 1000.0;
+    s->loadState.set(ok ? Sample::Loaded : Sample::LoadFailed);
+    _sampleEvent.signal();
+    return ok;
+}
+
+//---------------------------------------------------------
+//   Index
+//---------------------------------------------------------
+
+void SoundFont::setIndexFile (const File& index)
+{
+    _indexFile = index;
+}
+
+bool SoundFont::updateIndex()
+{
+    if (_indexFile == File() || _indexComplete || _path == File() || !isLoaded())
+        return true;
+    
+    if (!FontIndex::save(*this, _indexFile))
+    {
+        log("Cannot write index " + _indexFile.getFullPathName());
         return false;
     }
+    _indexComplete = true;
     return true;
 }
 
+//---------------------------------------------------------
+//   waitForSample
+//---------------------------------------------------------
+
+bool SoundFont::waitForSample (int index, int timeoutMs)
+{
+    Sample* s = _samples[index];
+    if (s == nullptr)
+        return false;
+    
+    if (s->loadState.get() == Sample::NotLoaded)
+        return loadSample(index);
+    
+    // Poll, since a WaitableEvent wakes only one of several waiters
+    const uint32 started = Time::getMillisecondCounter();
+    while (s->loadState.get() == Sample::Loading)
+    {
+        if (timeoutMs >= 0 && Time::getMillisecondCounter() - started >= (uint32)timeoutMs)
+            return false;
+        _sampleEvent.wait(10);
+    }
+    return s->loadState.get() == Sample::Loaded;
+}
+
+//---------------------------------------------------------
+//   closeInput
+//---------------------------------------------------------
+
+void SoundFont::closeInput()
+{
+    const ScopedLock sl (_readLock);
+    _infile = nullptr;
+}
+
 //---------------------------------------------------------
 //   skip
 //---------------------------------------------------------
@@ -404,6 +816,11 @@ String SoundFont::readString (int n)
 
 void SoundFont::readSection (const char* fourcc, int len)
 {
+    ProfileScope scope (Profiler::ReadSection);
+    scope.setLabel(String(fourcc, 4));
+    if (memcmp(fourcc, "smpl", 4) != 0)
+        scope.addBytesIn(len); // sample data is skipped here
+    
     switch(FOURCC(fourcc[0], fourcc[1], fourcc[2], fourcc[3])) {
     case FOURCC('i', 'f', 'i', 'l'):    // version
         readVersion();
@@ -469,12 +886,21 @@ void SoundFont::readSection (const char* fourcc, int len)
         readShdX(len);
         break;
             
+    case FOURCC('s','h','d','H'): // copies of sample heads in front of the sample data (SF2 only)
+        readShdH(len);
+        break;
+    
     case FOURCC('i', 'r', 'o', 'm'):    // sample rom
     case FOURCC('i', 'v', 'e', 'r'):    // sample rom version
-    default:
         skip(len);
         throw(String("unknown fourcc " + String(fourcc)));
         break;
+            
+    default:
+        // Extensions this version doesn't know, the file plays without them
+        log("Skipping unknown chunk " + String(fourcc));
+        skip(len);
+        break;
     }
 }
 
@@ -698,6 +1124,63 @@ void SoundFont::readShdX (int size)
     skip(SampleMetaSize);   // trailing record
 }
 
+//---------------------------------------------------------
+//   readShdH
+//---------------------------------------------------------
+
+void SoundFont::readShdH (int size)
+{
+    if (size % SampleHeadSize)
+        throw("shdH size not a multiple of 8");
+    
+    // Follows shdr, one record per sample plus the terminator
+    int n = size / SampleHeadSize;
+    if (n != _samples.size() + 1)
+        throw("shdH does not match sample headers");
+    
+    const int64 frames = _sampleLen / (int64)sizeof(short);
+    Array<SampleHead> heads;
+    for (int i = 0; i < n-1; ++i)
+    {
+        SampleHead h;
+        h.start  = readDword();
+        h.frames = readDword();
+        if ((int64)h.start + h.frames > frames)
+            throw("shdH points beyond sample data");
+        heads.add(h);
+    }
+    skip(SampleHeadSize);   // trailing record
+    _heads.swapWith(heads);
+}
+
+const SampleHead* SoundFont::getSampleHead (int i) const
+{
+    if (!isPositiveAndBelow(i, _heads.size()) || _heads.getReference(i).frames == 0)
+        return nullptr;
+    return &_heads.getReference(i);
+}
+
+bool SoundFont::getHeadsRange (int64& position, int64& numBytes) const
+{
+    int64 first = -1, last = 0;
+    for (int i = 0; i < _heads.size(); i++)
+    {
+        const SampleHead& h = _heads.getReference(i);
+        if (h.frames == 0)
+            continue;
+        if (first < 0 || h.start < first)
+            first = h.start;
+        last = jmax(last, (int64)h.start + h.frames);
+    }
+    
+    if (first < 0)
+        return false;
+    
+    position = _samplePos + first * sizeof(short);
+    numBytes = (last - first) * sizeof(short);
+    return true;
+}
+
 #if 0
 #pragma mark Writing SF2
 #endif
@@ -708,96 +1191,148 @@ void SoundFont::readShdX (int size)
 
 bool SoundFont::write (const File filename, FileType format, int quality)
 {
-    ScopedPointer<FileOutputStream> out = new FileOutputStream(filename);
+    Encoding encoding (format, quality, _samples.size());
+    return write(filename, encoding);
+}
+
+bool SoundFont::write (const File filename, Encoding& encoding)
+{
+    FileOutputStream out (filename);
+    if (out.failedToOpen())
+    {
+        error(String("cannot open " + filename.getFullPathName()));
+        return false;
+    }
+    out.setPosition(0);
+    out.truncate();
+    
+    return write(out, encoding, filename.getFileName());
+}
+
+bool SoundFont::write (OutputStream& out, Encoding& encoding, const String& name)
+{
+    // Several outputs may be assembled from the same samples, one at a time
+    const ScopedLock sl (_writeLock);
+    ProfileScope scope (Profiler::Write);
+    scope.setLabel(name);
     
-    _outfile = out;
-    _outfile->setPosition(0);
-    _outfile->truncate();
-    _fileFormatOut = format;
+    _outfile = &out;
+    _fileFormatOut = encoding.format;
     
     /** Add a warning that samples were decompressed from a lossy format */
+    String comment = _comment;
     if (_fileFormatIn == SF2::FileType::SF3Format && _fileFormatOut != _fileFormatIn)
     {
-        _comment << "\n\n" << "CAUTION: Samples in this file were decompressed from a lossy format (Ogg Vorbis). If you want to edit this file, you should get the original uncompressed SF2 file.";
+        comment << "\n\n" << "CAUTION: Samples in this file were decompressed from a lossy format (Ogg Vorbis). If you want to edit this file, you should get the original uncompressed SF2 file.";
     }
     
     int64 riffLenPos;
     int64 listLenPos;
     try {
+        if (encoding.payloads.size() != _samples.size())
+            throw(String("encoding does not match samples"));
+        
+        // Samples may still be loading, or not be loaded at all after readHeaders()
+        for (int i = 0; i < _samples.size(); i++)
+            if (!waitForSample(i))
+                throw(String("sample data not available: " + _samples[i]->name));
+        
         _outfile->write("RIFF", 4);
         riffLenPos = _outfile->getPosition();
         writeDword(0);
         _outfile->write("sfbk", 4);
 
+        int64 pos;
+        {
+            ProfileScope info (Profiler::WriteMetadata);
+            
+            _outfile->write("LIST", 4);
+            listLenPos = _outfile->getPosition();
+            writeDword(0);
+            _outfile->write("INFO", 4);
+
+            writeIfil();
+            if (_name.isNotEmpty())      writeStringSection("INAM", _name);
+            if (_engine.isNotEmpty())    writeStringSection("isng", _engine);
+            if (_product.isNotEmpty())   writeStringSection("IPRD", _product);
+            if (_creator.isNotEmpty())   writeStringSection("IENG", _creator);
+            if (_tools.isNotEmpty())     writeStringSection("ISFT", _tools);
+            if (_date.isNotEmpty())      writeStringSection("ICRD", _date);
+            if (comment.isNotEmpty())    writeStringSection("ICMT", comment);
+            if (_copyright.isNotEmpty()) writeStringSection("ICOP", _copyright);
+
+            pos = _outfile->getPosition();
+            _outfile->setPosition(listLenPos);
+            writeDword(pos - listLenPos - 4);
+            _outfile->setPosition(pos);
+            info.addBytesOut(pos - listLenPos + 4);
+        }
+
         _outfile->write("LIST", 4);
         listLenPos = _outfile->getPosition();
         writeDword(0);
-        _outfile->write("INFO", 4);
-
-        writeIfil();
-        if (_name.isNotEmpty())      writeStringSection("INAM", _name);
-        if (_engine.isNotEmpty())    writeStringSection("isng", _engine);
-        if (_product.isNotEmpty())   writeStringSection("IPRD", _product);
-        if (_creator.isNotEmpty())   writeStringSection("IENG", _creator);
-        if (_tools.isNotEmpty())     writeStringSection("ISFT", _tools);
-        if (_date.isNotEmpty())      writeStringSection("ICRD", _date);
-        if (_comment.isNotEmpty())   writeStringSection("ICMT", _comment);
-        if (_copyright.isNotEmpty()) writeStringSection("ICOP", _copyright);
-
-        int64 pos = _outfile->getPosition();
+        
+        _outfile->write("sdta", 4);
+        writeSmpl(encoding);
+        pos = _outfile->getPosition();
         _outfile->setPosition(listLenPos);
         writeDword(pos - listLenPos - 4);
         _outfile->setPosition(pos);
 
-        _outfile->write("LIST", 4);
-        listLenPos = _outfile->getPosition();
-        writeDword(0);
-        
-        _outfile->write("sdta", 4);
-        writeSmpl(quality);
-        pos = _outfile->getPosition();
-        _outfile->setPosition(listLenPos);
-        writeDword(pos - listLenPos - 4);
-        _outfile->setPosition(pos);
-
-        _outfile->write("LIST", 4);
-        listLenPos = _outfile->getPosition();
-        writeDword(0);
-        _outfile->write("pdta", 4);
-
-        writePhdr();
-        writeBag("pbag", &_pZones);
-        writeMod("pmod", &_pZones);
-        writeGen("pgen", &_pZones);
-        writeInst();
-        writeBag("ibag", &_iZones);
-        writeMod("imod", &_iZones);
-        writeGen("igen", &_iZones);
-        writeShdr();
-        
-        if (_fileFormatOut != SF2Format)
-            writeShdX();
-
-        pos = _outfile->getPosition();
-        _outfile->setPosition(listLenPos);
-        writeDword(pos - listLenPos - 4);
-        _outfile->setPosition(pos);
+        {
+            ProfileScope pdta (Profiler::WriteMetadata);
+            
+            _outfile->write("LIST", 4);
+            listLenPos = _outfile->getPosition();
+            writeDword(0);
+            _outfile->write("pdta", 4);
+
+            writePhdr();
+            writeBag("pbag", &_pZones);
+            writeMod("pmod", &_pZones);
+            writeGen("pgen", &_pZones);
+            writeInst();
+            writeBag("ibag", &_iZones);
+            writeMod("imod", &_iZones);
+            writeGen("igen", &_iZones);
+            writeShdr();
+            
+            if (_fileFormatOut != SF2Format)
+                writeShdX();
+            else if (_headsOut.size() > 0)
+                writeShdH();
+
+            pos = _outfile->getPosition();
+            _outfile->setPosition(listLenPos);
+            writeDword(pos - listLenPos - 4);
+            _outfile->setPosition(pos);
+            pdta.addBytesOut(pos - listLenPos + 4);
+        }
 
         int64 endPos = _outfile->getPosition();
         _outfile->setPosition(riffLenPos);
         writeDword(endPos - riffLenPos - 4);
         
         _fileSizeOut = endPos;
+        scope.addBytesOut(endPos);
     }
     catch (String s) {
-        log(String("write SF2 file failed: " + s));
+        error(String("write SF2 file failed: " + s));
+        return false;
+    }
+    catch (const char* s) {
+        error(String("write SF2 file failed: ") + s);
         return false;
     }
     
-    String msg;
-    int percent = round(100 * (double)_fileSizeOut/(double)_fileSizeIn);
-    msg << "File size change: "  << percent << "%";
-    log(msg);
+    // Unknown for fonts built in memory
+    if (_fileSizeIn > 0)
+    {
+        String msg;
+        int percent = round(100 * (double)_fileSizeOut/(double)_fileSizeIn);
+        msg << "File size change: "  << percent << "%";
+        log(msg);
+    }
     
     return true;
 }
@@ -906,10 +1441,12 @@ void SoundFont::writeIfil()
     write("ifil", 4);
     writeDword(4);
     unsigned char data[4];
-    if (_fileFormatOut == SF3Format) _version.major = 3;
-    if (_fileFormatOut == SF4Format) _version.major = 4;
-    data[0] = _version.major;
-    data[1] = _version.major >> 8;
+    // Major version tells the compression format, so it is never carried over
+    int major = 2;
+    if (_fileFormatOut == SF3Format) major = 3;
+    if (_fileFormatOut == SF4Format) major = 4;
+    data[0] = major;
+    data[1] = major >> 8;
     data[2] = _version.minor;
     data[3] = _version.minor >> 8;
     write((char*)data, 4);
@@ -1109,30 +1646,44 @@ void SoundFont::writeShdr()
     write("shdr", 4);
     writeDword(46 * (_samples.size() + 1));
 
+    jassert (_headersOut.size() == _samples.size());
     for (int i = 0; i < _samples.size(); i++)
-        writeShdrEach(_samples[i]);
+        writeShdrEach(_samples[i], _headersOut.getReference(i));
 
     // Empty last sample as terminator
     Sample s;
-    writeShdrEach(&s);
+    writeShdrEach(&s, SampleHeader());
 }
 
 //---------------------------------------------------------
 //   writeShdrEach
 //---------------------------------------------------------
 
-void SoundFont::writeShdrEach (const Sample* s)
+void SoundFont::writeShdrEach (const Sample* s, const SampleHeader& h)
 {
     writeString(s->name, 20);
-    writeDword(s->start);
-    writeDword(s->end);
-    writeDword(s->loopstart);
-    writeDword(s->loopend);
+    writeDword(h.start);
+    writeDword(h.end);
+    writeDword(h.loopstart);
+    writeDword(h.loopend);
     writeDword(s->samplerate);
     writeByte(s->origpitch);
     writeChar(s->pitchadj);
     writeWord(s->sampleLink);
-    writeWord(s->sampletype);
+    writeWord(h.sampletype);
+}
+
+//---------------------------------------------------------
+//   SampleHeader
+//---------------------------------------------------------
+
+SoundFont::SampleHeader::SampleHeader (const Sample* s, SampleCompression c) :
+    start(s->start),
+    end(s->end),
+    loopstart(s->loopstart),
+    loopend(s->loopend),
+    sampletype(Sample::withCompressionType(s->sampletype, c))
+{
 }
 
 //---------------------------------------------------------
@@ -1161,6 +1712,28 @@ void SoundFont::writeShdX()
     writeShdXEach(&m);
 }
 
+//---------------------------------------------------------
+//   writeShdH
+//---------------------------------------------------------
+
+void SoundFont::writeShdH()
+{
+    jassert (_headsOut.size() == _samples.size());
+    
+    write("shdH", 4);
+    writeDword(SampleHeadSize * (_samples.size() + 1));
+    
+    for (int i = 0; i < _headsOut.size(); i++)
+    {
+        writeDword(_headsOut.getReference(i).start);
+        writeDword(_headsOut.getReference(i).frames);
+    }
+    
+    // Empty terminator
+    writeDword(0);
+    writeDword(0);
+}
+
 //---------------------------------------------------------
 //   writeShdXEach
 //---------------------------------------------------------
@@ -1183,69 +1756,116 @@ void SoundFont::writeShdXEach (const SampleMeta* m)
 //   writeSmpl
 //---------------------------------------------------------
 
-void SoundFont::writeSmpl (int quality)
+void SoundFont::writeSmpl (Encoding& encoding)
 {
-    /* Write sample data chunk and update each Sample's metadata
-     to reflect the actual written offsets */
+    /* Write sample data chunk and collect the header of each Sample
+     as written, to reflect the actual written offsets. Samples in
+     memory remain untouched, so they can be written again. */
+    
+    ProfileScope scope (Profiler::WriteSmpl);
     
     write("smpl", 4);
     int64 pos = _outfile->getPosition();
     writeDword(0);
     
+    // SF2 offsets count 16 bit frames, so padding must come in pairs of bytes
+    const SampleLayout& layout = encoding.layout;
+    const int64 dataPos = pos + 4;
+    jassert (layout.alignment % 2 == 0 && dataPos % 2 == 0);
+    
+    // Headers are indexed like samples, whatever order the data is in
+    Array<int> order;
+    if (layout.byPreset)
+        order = getSamplesByPreset();
+    else
+        for (int i = 0; i < _samples.size(); i++)
+            order.add(i);
+    
+    _headersOut.clearQuick();
+    _headersOut.insertMultiple(0, SampleHeader(), _samples.size());
+    _headsOut.clearQuick();
     int64 offsetFromChunk = 0;
     switch (_fileFormatOut)
     {
         case SF2Format: // SF2
         {
-            for (int i = 0; i < _samples.size(); i++)
+            // Heads-first: copies of all heads, then the whole samples
+            if (layout.headFrames > 0)
             {
+                _headsOut.insertMultiple(0, SampleHead(), _samples.size());
+                offsetFromChunk += alignSample(dataPos + offsetFromChunk, layout.alignment);
+                
+                for (int n = 0; n < order.size(); n++)
+                {
+                    const int i = order.getUnchecked(n);
+                    const Sample* s = _samples.getUnchecked(i);
+                    
+                    SampleHead& h = _headsOut.getReference(i);
+                    h.start = offsetFromChunk / sizeof(short);
+                    h.frames = jmin(layout.headFrames, s->numSamples());
+                    write((const char*)s->sampleData, h.frames * sizeof(short));
+                    offsetFromChunk += h.frames * sizeof(short);
+                }
+            }
+            
+            for (int n = 0; n < order.size(); n++)
+            {
+                const int i = order.getUnchecked(n);
                 Sample* s = _samples.getUnchecked(i);
+                offsetFromChunk += alignSample(dataPos + offsetFromChunk, layout.alignment);
                 int written = writeSampleDataPlain(s);
                 
-                s->setCompressionType(Raw);
+                SampleHeader h (s, Raw);
                 // Offsets in SF2 format based on 'sample count'
-                s->start = offsetFromChunk / sizeof(short);
+                h.start = offsetFromChunk / sizeof(short);
                 offsetFromChunk += written;
-                s->end = offsetFromChunk / sizeof(short);
+                h.end = offsetFromChunk / sizeof(short);
                 // turn relative loop points to absolute, as SF2 format requires
-                s->loopstart += s->start;
-                s->loopend   += s->start;
+                h.loopstart += h.start;
+                h.loopend   += h.start;
+                _headersOut.set(i, h);
             }
             break;
         }
         case SF3Format: // SF3
         {
-            for (int i = 0; i < _samples.size(); i++)
+            for (int n = 0; n < order.size(); n++)
             {
+                const int i = order.getUnchecked(n);
                 Sample* s = _samples.getUnchecked(i);
-                int written = writeSampleDataVorbis(s, quality);
+                offsetFromChunk += alignSample(dataPos + offsetFromChunk, layout.alignment);
+                int written = writeSampleDataEncoded(i, encoding);
                 
-                s->setCompressionType(Vorbis);
+                SampleHeader h (s, Vorbis);
                 // Offsets in SF3 based on byte offset in file.
                 // Hack start/end of sample metadata to accommodate this:
-                s->start = offsetFromChunk;
+                h.start = offsetFromChunk;
                 offsetFromChunk += written;
-                s->end = offsetFromChunk;
+                h.end = offsetFromChunk;
                 // Important: keep relative loop offsets in file, so it can be restored after loading.
                 // Loop is already relative ...
+                _headersOut.set(i, h);
             }
             break;
         }
         case SF4Format: // SF4
         {
-            for (int i = 0; i < _samples.size(); i++)
+            for (int n = 0; n < order.size(); n++)
             {
+                const int i = order.getUnchecked(n);
                 Sample* s = _samples.getUnchecked(i);
-                int written = writeSampleDataFlac(s, quality);
+                offsetFromChunk += alignSample(dataPos + offsetFromChunk, layout.alignment);
+                int written = writeSampleDataEncoded(i, encoding);
                 
-                s->setCompressionType(Flac);
+                SampleHeader h (s, Flac);
                 // Offsets in SF4 based on byte offset in file.
                 // Hack start/end of sample metadata to accommodate this:
-                s->start = offsetFromChunk;
+                h.start = offsetFromChunk;
                 offsetFromChunk += written;
-                s->end = offsetFromChunk;
+                h.end = offsetFromChunk;
                 // Important: keep relative loop offsets in file, so it can be restored after loading.
                 // Loop is already relative ...
+                _headersOut.set(i, h);
             }
             break;
         }
@@ -1254,6 +1874,20 @@ void SoundFont::writeSmpl (int quality)
     _outfile->setPosition(pos);
     writeDword(npos - pos - 4);
     _outfile->setPosition(npos);
+    scope.addBytesOut(npos - pos + 4);
+}
+
+/** Pads with zeros up to the next multiple of alignment in the file, and
+    returns the number of bytes written. Readers never look at the padding,
+    since each sample header points at its own data. */
+int64 SoundFont::alignSample (int64 position, int alignment)
+{
+    if (alignment <= 0 || position % alignment == 0)
+        return 0;
+    
+    const int64 padding = alignment - position % alignment;
+    _outfile->writeRepeatedByte(0, (size_t)padding);
+    return padding;
 }
 
 
@@ -1268,6 +1902,9 @@ void SoundFont::writeSmpl (int quality)
 
 int SoundFont::readSampleData(Sample* s)
 {
+    if (_infile == nullptr)
+        throw("sample data not available, file is closed");
+    
 #if USE_MULTIPLE_COMPRESSION_FORMATS
     switch (s->getCompressionType())
     {
@@ -1297,13 +1934,17 @@ int SoundFont::readSampleData(Sample* s)
 
 int SoundFont::readSampleDataRaw (Sample* s)
 {
-    // Offsets in SF2 are based on samples (short)
-    _infile->setPosition(_samplePos + s->start * sizeof(short));
-    
+    ProfileScope scope (Profiler::ReadSampleRaw);
+    scope.setLabel(s->name);
     int numSamples = (s->end - s->start);
-    s->sampleDataSize = numSamples;
-    s->sampleData = new short[numSamples];
-    int read = _infile->read(s->sampleData, numSamples * sizeof(short));
+    s->allocateSampleData(numSamples);
+    int read;
+    {
+        // Offsets in SF2 are based on samples (short)
+        const ScopedLock sl (_readLock);
+        _infile->setPosition(_samplePos + s->start * sizeof(short));
+        read = _infile->read(s->sampleData, numSamples * sizeof(short));
+    }
     
     // normalize offsets & make loop relative
     s->loopstart -= s->start;
@@ -1313,6 +1954,8 @@ int SoundFont::readSampleDataRaw (Sample* s)
     
     s->createMeta();
     
+    scope.addBytesIn(read);
+    scope.addBytesOut(read);
     return read;
 }
 
@@ -1322,36 +1965,19 @@ int SoundFont::readSampleDataRaw (Sample* s)
 
 int SoundFont::readSampleDataVorbis (Sample* s)
 {
+    ProfileScope scope (Profiler::ReadSampleVorbis);
+    scope.setLabel(s->name);
     // Offsets in SF3 are bytes
     int numBytes = (s->end - s->start);
-    s->byteDataSize = numBytes;
-    s->byteData = new byte[numBytes];
-    _infile->setPosition(_samplePos + s->start);
-    _infile->read(s->byteData, numBytes);
-    
-#if USE_JUCE_VORBIS
-    
-    MemoryInputStream* input = new MemoryInputStream(s->byteData, s->byteDataSize, false);
-    ScopedPointer<AudioFormatReader> reader = _audioFormatVorbis->createReaderFor(input, true);
-    if (reader == nullptr)
-        throw("Failed decoding Vorbis data!");
-    int numSamples = reader->lengthInSamples;
-    AudioSampleBuffer buffer (1, numSamples);
-    buffer.clear();
-    reader->read(&buffer, 0, numSamples, 0, 1, 1);
-    
-    // copy buffer to sampleData
-    s->sampleDataSize = numSamples;
-    s->sampleData = new short[numSamples];
-    const float* b = buffer.getReadPointer(0);
-    for (int i=0; i < numSamples; i++)
-        s->sampleData[i] = round(b[i] * 32768.f);
-#else
-    
-    decodeOggVorbis(s);
-    int numSamples = s->numSamples();
+    s->allocateByteData(numBytes);
+    {
+        // Only file access is serialized, decoding runs in parallel
+        const ScopedLock sl (_readLock);
+        _infile->setPosition(_samplePos + s->start);
+        _infile->read(s->byteData, numBytes);
+    }
     
-#endif
+    int numSamples = decodeByteData(s, SF3Format);
     
     // normalize offsets & make loop relative
     s->start = 0;
@@ -1362,6 +1988,9 @@ int SoundFont::readSampleDataVorbis (Sample* s)
     
     jassert (s->checkMeta());
     s->dropByteData();
+    
+    scope.addBytesIn(numBytes);
+    scope.addBytesOut(numSamples * sizeof(short));
     return numBytes;
 }
 
@@ -1371,41 +2000,73 @@ int SoundFont::readSampleDataVorbis (Sample* s)
 
 int SoundFont::readSampleDataFlac (Sample* s)
 {
+    ProfileScope scope (Profiler::ReadSampleFlac);
+    scope.setLabel(s->name);
     // Offsets in SF4 are bytes
     int numBytes = (s->end - s->start);
-    s->byteDataSize = numBytes;
-    s->byteData = new byte[numBytes];
-    _infile->setPosition(_samplePos + s->start);
-    _infile->read(s->byteData, numBytes);
+    s->allocateByteData(numBytes);
+    {
+        // Only file access is serialized, decoding runs in parallel
+        const ScopedLock sl (_readLock);
+        _infile->setPosition(_samplePos + s->start);
+        _infile->read(s->byteData, numBytes);
+    }
     
+    int numSamples = decodeByteData(s, SF4Format);
+    
+    // normalize offsets & make loop relative
+    s->start = 0;
+    s->end = numSamples;
+    // loop in file was already relative ...
+    //s->loopstart -= s->start;
+    //s->loopend   -= s->start;
+    
+    s->dropByteData();
+    jassert (s->checkMeta());
+    
+    scope.addBytesIn(numBytes);
+    scope.addBytesOut(numSamples * sizeof(short));
+    return numBytes;
+}
+
+
+
+
+//---------------------------------------------------------
+//   decodeByteData
+//---------------------------------------------------------
+
+/** Decodes the compressed byteData of a sample into its sampleData
+    and returns the number of samples. Throws on failure. */
+int SoundFont::decodeByteData (Sample* s, FileType format)
+{
+#if ! USE_JUCE_VORBIS
+    if (format == SF3Format)
+    {
+        decodeOggVorbis(s);
+        return s->numSamples();
+    }
+#endif
+    
+    AudioFormat* audioFormat = CodecRegistry::getInstance().getFormat(format);
     MemoryInputStream* input = new MemoryInputStream(s->byteData, s->byteDataSize, false);
-    ScopedPointer<AudioFormatReader> reader = _audioFormatFlac->createReaderFor(input, true);
+    ScopedPointer<AudioFormatReader> reader = audioFormat->createReaderFor(input, true);
     if (reader == nullptr)
-        throw("Failed decoding FLAC data!");
+        throw(format == SF3Format ? "Failed decoding Vorbis data!" : "Failed decoding FLAC data!");
     
     int numSamples = reader->lengthInSamples;
+    ScopedMemoryUse scratch (MemoryStats::CodecScratch, numSamples * sizeof(float));
     AudioSampleBuffer buffer (1, numSamples);
     buffer.clear();
     reader->read(&buffer, 0, numSamples, 0, 1, 1);
     
     // copy buffer to sampleData
-    s->sampleDataSize = numSamples;
-    s->sampleData = new short[numSamples];
+    s->allocateSampleData(numSamples);
     const float* b = buffer.getReadPointer(0);
     for (int i=0; i < numSamples; i++)
         s->sampleData[i] = round(b[i] * 32768.f);
     
-    // normalize offsets & make loop relative
-    s->start = 0;
-    s->end = numSamples;
-    // loop in file was already relative ...
-    //s->loopstart -= s->start;
-    //s->loopend   -= s->start;
-    
-    s->dropByteData();
-    jassert (s->checkMeta());
-    
-    return numBytes;
+    return numSamples;
 }
 
 
@@ -1430,53 +2091,229 @@ int SoundFont::writeSampleDataPlain (Sample* s)
 
     
 //---------------------------------------------------------
-//   writeSampleDataVorbis
+//   writeSampleDataEncoded
+//---------------------------------------------------------
+
+int SoundFont::writeSampleDataEncoded (int index, Encoding& encoding)
+{
+    // Encode right now, unless this was done ahead of writing
+    if (encoding.payloads[index] == nullptr && !encodeSample(index, encoding))
+        throw(String("encoding failed: " + _samples[index]->name));
+    
+    const MemoryBlock* payload = encoding.payloads.getUnchecked(index);
+    int numBytes = (int)payload->getSize();
+    write((const char*)payload->getData(), numBytes);
+    return numBytes;
+}
+
+//---------------------------------------------------------
+//   encodeSample
+//---------------------------------------------------------
+
+static int getVorbisOption (int quality);
+static int getFlacOption (int quality);
+
+bool SoundFont::encodeSample (int index, Encoding& encoding)
+{
+    Sample* s = _samples[index];
+    if (s == nullptr || !waitForSample(index))
+        return false;
+    
+    ScopedPointer<MemoryBlock> payload = new MemoryBlock();
+    const double started = Time::getMillisecondCounterHiRes();
+    switch (encoding.format)
+    {
+        case SF3Format:
+            encodeSampleDataVorbis(s, getVorbisOption(encoding.quality), *payload);
+            break;
+        case SF4Format:
+            encodeSampleDataFlac(s, getFlacOption(encoding.quality), *payload);
+            break;
+        default:
+            return true; // SF2 is written straight from sample data
+    }
+    
+    if (payload->getSize() == 0)
+        return false;
+    
+    encoding.seconds.set(index, (Time::getMillisecondCounterHiRes() - started) / 1000.0);
+    MemoryStats::allocated(MemoryStats::Compressed, payload->getSize());
+    encoding.payloads.set(index, payload.release());
+    return true;
+}
+
+//---------------------------------------------------------
+//   Encoder settings
+//---------------------------------------------------------
+
+/**
+ 0: 64 kbps
+ 1: 80 kbps
+ 2: 96 kbps
+ 3: 112 kbps
+ 4: 128 kbps
+ 5: 160 kbps
+ 6: 192 kbps
+ 7: 224 kbps
+ 8: 256 kbps
+ 9: 320 kbps
+ 10: 500 kbps */
+static int getVorbisOption (int quality)
+{
+    switch (quality) {
+        case 0: return 5;  // Low quality
+        case 1: return 8;  // Medium quality
+        case 2: return 10; // High quality
+    }
+    return 4;
+}
+
+/**
+ 0: 0 (Fastest)
+ 1: 1
+ 2: 2
+ 3: 3
+ 4: 4
+ 5: 5 (Default)
+ 6: 6
+ 7: 7
+ 8: 8 (Highest quality) */
+static int getFlacOption (int quality)
+{
+    switch (quality) {
+        case 0: return 1; // Low quality
+        case 1: return 5; // Medium quality
+        case 2: return 8; // High quality
+    }
+    return 8;
+}
+
+String SoundFont::getEncoderSetting (FileType format, int quality) const
+{
+    switch (format)
+    {
+        case SF3Format: return "Vorbis " + CodecRegistry::getInstance().getQualityOptions(format)[getVorbisOption(quality)];
+        case SF4Format: return "FLAC "   + CodecRegistry::getInstance().getQualityOptions(format)[getFlacOption(quality)];
+        default:        return "PCM 16 bit";
+    }
+}
+
+int SoundFont::getEncoderOption (FileType format, int quality) const
+{
+    switch (format)
+    {
+        case SF3Format: return getVorbisOption(quality);
+        case SF4Format: return getFlacOption(quality);
+        default:        return 0;
+    }
+}
+
+StringArray SoundFont::getEncoderOptions (FileType format) const
+{
+    return CodecRegistry::getInstance().getQualityOptions(format);
+}
+
+//---------------------------------------------------------
+//   Ogg stream serial
+//---------------------------------------------------------
+
+/** Ogg streams are normally tagged with a random serial number. Samples are
+    separate streams never chained or multiplexed, so a fixed serial does no
+    harm, but makes the output reproducible for caching and comparison. */
+static const uint32 oggStreamSerial = 0x53463321; // "SF3!"
+
+#if USE_JUCE_VORBIS
+
+/** The JUCE writer picks a random serial, so this patches it in all pages
+    of the stream and updates their checksums */
+struct OggCrcTable
+{
+    OggCrcTable()
+    {
+        for (uint32 i = 0; i < 256; i++)
+        {
+            uint32 r = i << 24;
+            for (int k = 0; k < 8; k++)
+                r = (r & 0x80000000) ? (r << 1) ^ 0x04c11db7 : (r << 1);
+            entries[i] = r;
+        }
+    }
+    uint32 entries[256];
+};
+
+static void setOggStreamSerial (MemoryBlock& stream, uint32 serial)
+{
+    static const OggCrcTable crcTable;
+    
+    uint8* data = (uint8*)stream.getData();
+    const size_t size = stream.getSize();
+    size_t pos = 0;
+    
+    while (pos + 27 <= size && memcmp(data + pos, "OggS", 4) == 0)
+    {
+        uint8* page = data + pos;
+        const int numSegments = page[26];
+        if (pos + 27 + numSegments > size)
+            break;
+        
+        size_t pageSize = 27 + numSegments;
+        for (int i = 0; i < numSegments; i++)
+            pageSize += page[27 + i];
+        if (pos + pageSize > size)
+            break;
+        
+        // Serial and checksum are little endian, the checksum covers the
+        // whole page with the checksum field zeroed
+        for (int i = 0; i < 4; i++)
+        {
+            page[14 + i] = (uint8)(serial >> (8 * i));
+            page[22 + i] = 0;
+        }
+        
+        uint32 crc = 0;
+        for (size_t i = 0; i < pageSize; i++)
+            crc = (crc << 8) ^ crcTable.entries[((crc >> 24) & 0xff) ^ page[i]];
+        for (int i = 0; i < 4; i++)
+            page[22 + i] = (uint8)(crc >> (8 * i));
+        
+        pos += pageSize;
+    }
+}
+
+#endif // USE_JUCE_VORBIS
+
+//---------------------------------------------------------
+//   encodeSampleDataVorbis
 //---------------------------------------------------------
 
-int SoundFont::writeSampleDataVorbis (Sample* s, int quality)
+int SoundFont::encodeSampleDataVorbis (const Sample* s, int option, MemoryBlock& output)
 {
+    ProfileScope scope (Profiler::EncodeVorbis);
+    scope.setLabel(s->name);
     jassert (s->numSamples() > 0);
     const int numSamples = s->numSamples();
     int rawBytes = numSamples * sizeof(short);
-    int option = 4;
     
 #if USE_JUCE_VORBIS
     
+    ScopedMemoryUse scratch (MemoryStats::CodecScratch, numSamples * sizeof(float));
     AudioSampleBuffer buffer (1, numSamples);
     float* b = buffer.getWritePointer(0);
     for (int i=0; i < numSamples; i++)
         b[i] = (float)s->sampleData[i] / 32768.f; // scale to unity
     
-    /**
-     0: 64 kbps
-     1: 80 kbps
-     2: 96 kbps
-     3: 112 kbps
-     4: 128 kbps
-     5: 160 kbps
-     6: 192 kbps
-     7: 224 kbps
-     8: 256 kbps
-     9: 320 kbps
-     10: 500 kbps */
-    switch (quality) {
-        case 0: option = 5; break; // Low quality
-        case 1: option = 8; break; // Medium quality
-        case 2: option = 10; break; // High quality
-    }
-    jassert(option < _qualityOptionsVorbis.size());
+    jassert(option < CodecRegistry::getInstance().getQualityOptions(SF3Format).size());
   
-    MemoryBlock output;
     {
         MemoryOutputStream* temp = new MemoryOutputStream(output, false);
-        ScopedPointer<AudioFormatWriter> writer = _audioFormatVorbis->
+        ScopedPointer<AudioFormatWriter> writer = CodecRegistry::getInstance().getFormat(SF3Format)->
             createWriterFor(temp, s->samplerate, 1, 16, nullptr, option);
         writer->writeFromAudioSampleBuffer(buffer,0,numSamples);
         // writer MUST be deleted to properly flush & close ...
     }
+    setOggStreamSerial(output, oggStreamSerial);
     
     int numBytes = output.getSize();
-    write((char*)output.getData(), numBytes);
     
 #else  // USE_JUCE_VORBIS
 
@@ -1490,11 +2327,12 @@ int SoundFont::writeSampleDataVorbis (Sample* s, int quality)
     
     vorbis_info_init(&vi);
     
-    float qualityF = 1.0f;
-    switch (quality) {
-        case 0: option = 5; qualityF = 0.2f; break; // Low quality
-        case 1: option = 8; qualityF = 0.6f; break; // Medium quality
-        case 2: option = 10; qualityF = 1.0f; break; // High quality
+    // Options of the JUCE writer are bitrates, mapped to VBR quality here
+    float qualityF = option / 10.0f;
+    switch (option) {
+        case 5:  qualityF = 0.2f; break; // Low quality
+        case 8:  qualityF = 0.6f; break; // Medium quality
+        case 10: qualityF = 1.0f; break; // High quality
     }
     
     int ret = vorbis_encode_init_vbr(&vi, 1, s->samplerate, qualityF);
@@ -1506,8 +2344,7 @@ int SoundFont::writeSampleDataVorbis (Sample* s, int quality)
     vorbis_comment_init(&vc);
     vorbis_analysis_init(&vd, &vi);
     vorbis_block_init(&vd, &vb);
-    srand(time(NULL));
-    ogg_stream_init(&os, rand());
+    ogg_stream_init(&os, oggStreamSerial);
     
     ogg_packet header;
     ogg_packet header_comm;
@@ -1518,6 +2355,7 @@ int SoundFont::writeSampleDataVorbis (Sample* s, int quality)
     ogg_stream_packetin(&os, &header_comm);
     ogg_stream_packetin(&os, &header_code);
     
+    ScopedMemoryUse scratch (MemoryStats::CodecScratch, 1048576);
     char* obuf = new char[1048576]; // 1024 * 1024
     char* p = obuf;
     
@@ -1598,16 +2436,19 @@ int SoundFont::writeSampleDataVorbis (Sample* s, int quality)
     vorbis_info_clear(&vi);
     
     int numBytes = p - obuf;
-    write(obuf, numBytes);
+    output.replaceWith(obuf, numBytes);
     delete [] obuf;
     
 #endif // USE_JUCE_VORBIS
     
     String msg;
     int percent = roundf(100.f * (float)numBytes/(float)rawBytes);
-    msg << "Compressed " << _qualityOptionsVorbis[option] << ": " << s->name << " (" << percent << "%)";
+    msg << "Compressed " << CodecRegistry::getInstance().getQualityOptions(SF3Format)[option] << ": " << s->name << " (" << percent << "%)";
     log(msg);
     
+    scope.addBytesIn(rawBytes);
+    scope.addBytesOut(numBytes);
+    
     return numBytes;
 }
 
@@ -1615,53 +2456,41 @@ int SoundFont::writeSampleDataVorbis (Sample* s, int quality)
 
 
 //---------------------------------------------------------
-//   writeSampleDataFlac
+//   encodeSampleDataFlac
 //---------------------------------------------------------
 
-int SoundFont::writeSampleDataFlac (Sample* s, int quality)
+int SoundFont::encodeSampleDataFlac (const Sample* s, int option, MemoryBlock& output)
 {
+    ProfileScope scope (Profiler::EncodeFlac);
+    scope.setLabel(s->name);
     jassert (s->numSamples() > 0);
     const int numSamples = s->numSamples();
     int rawBytes = numSamples * sizeof(short);
 
+    ScopedMemoryUse scratch (MemoryStats::CodecScratch, numSamples * sizeof(float));
     AudioSampleBuffer buffer (1, numSamples);
     float* b = buffer.getWritePointer(0);
     for (int i=0; i < numSamples; i++)
         b[i] = (float)s->sampleData[i] / 32768.f; // scale to unity
     
-    int option = 8;
-    /**
-     0: 0 (Fastest)
-     1: 1
-     2: 2
-     3: 3
-     4: 4
-     5: 5 (Default)
-     6: 6
-     7: 7
-     8: 8 (Highest quality) */
-    switch (quality) {
-        case 0: option = 1; break; // Low quality
-        case 1: option = 5; break; // Medium quality
-        case 2: option = 8; break; // High quality
-    }
-    jassert(option < _qualityOptionsFlac.size());
+    jassert(option < CodecRegistry::getInstance().getQualityOptions(SF4Format).size());
     
-    MemoryBlock output;
     {
         MemoryOutputStream* temp = new MemoryOutputStream(output, false);
-        ScopedPointer<AudioFormatWriter>  writer = _audioFormatFlac->
+        ScopedPointer<AudioFormatWriter>  writer = CodecRegistry::getInstance().getFormat(SF4Format)->
                 createWriterFor(temp, s->samplerate, 1, 16, nullptr, option);
         writer->writeFromAudioSampleBuffer(buffer,0,numSamples);
         // writer MUST be deleted to properly flush & close ...
     }
     int numBytes = output.getSize();
-    write((char*)output.getData(), numBytes);
     
     String msg;
     int percent = roundf(100.f * (float)numBytes/(float)rawBytes);
-    msg << "Compressed FLAC " << _qualityOptionsFlac[option] << ": " << s->name << " (" << percent << "%)";
+    msg << "Compressed FLAC " << CodecRegistry::getInstance().getQualityOptions(SF4Format)[option] << ": " << s->name << " (" << percent << "%)";
     log(msg);
+    
+    scope.addBytesIn(rawBytes);
+    scope.addBytesOut(numBytes);
 
     return numBytes;
 }
@@ -1762,12 +2591,12 @@ bool SoundFont::decodeOggVorbis (Sample* s)
     
     // Copy uncompressed samples
     int numBytes = output.getDataSize();
+    ScopedMemoryUse scratch (MemoryStats::CodecScratch, numBytes);
     jassert (numBytes % sizeof(short) == 0); // must be even
     
     int numSamples = numBytes / sizeof(short);
     jassert (numSamples > 0);
-    s->sampleDataSize = numSamples;
-    s->sampleData = new short[numSamples];
+    s->allocateSampleData(numSamples);
     memcpy(s->sampleData, output.getData(), numBytes);
     
     return true;
@@ -1779,6 +2608,352 @@ bool SoundFont::decodeOggVorbis (Sample* s)
 #pragma mark Misc
 #endif
 
+//---------------------------------------------------------
+//   getPresetsByNumber
+//---------------------------------------------------------
+
+/** Orders preset indices by bank & program */
+struct PresetNumberSorter
+{
+    PresetNumberSorter (const OwnedArray<Preset>& p) : presets(p) {};
+    
+    int compareElements (int a, int b) const
+    {
+        const Preset* p = presets.getUnchecked(a);
+        const Preset* q = presets.getUnchecked(b);
+        if (p->bank != q->bank)
+            return p->bank < q->bank ? -1 : 1;
+        return p->preset - q->preset;
+    }
+    
+    const OwnedArray<Preset>& presets;
+};
+
+Array<int> SoundFont::getPresetsByNumber() const
+{
+    Array<int> order;
+    for (int i = 0; i < _presets.size(); i++)
+        order.add(i);
+    
+    PresetNumberSorter sorter (_presets);
+    order.sort(sorter, true);
+    return order;
+}
+
+//---------------------------------------------------------
+//   getSamplesByPreset
+//---------------------------------------------------------
+
+/** Mono samples usually link to sample 0, which means nothing */
+static bool isStereo (const Sample* s)
+{
+    return (s->sampletype & (Left | Right | Linked)) != 0;
+}
+
+/** Loading one preset then reads one contiguous range of the file */
+Array<int> SoundFont::getSamplesByPreset() const
+{
+    Array<int> order;
+    Array<bool> placed;
+    placed.insertMultiple(0, false, _samples.size());
+    
+    const Array<int> presets = getPresetsByNumber();
+    for (int p = 0; p < presets.size(); p++)
+    {
+        const Preset* preset = _presets.getUnchecked(presets.getUnchecked(p));
+        for (int z = 0; z < preset->zones.size(); z++)
+        {
+            const OwnedArray<GeneratorList>& pgens = preset->zones.getUnchecked(z)->generators;
+            for (int g = 0; g < pgens.size(); g++)
+            {
+                if (pgens.getUnchecked(g)->gen != Gen_Instrument)
+                    continue;
+                
+                const Instrument* instrument = _instruments[pgens.getUnchecked(g)->amount.uword];
+                if (instrument == nullptr)
+                    continue;
+                
+                for (int iz = 0; iz < instrument->zones.size(); iz++)
+                {
+                    const OwnedArray<GeneratorList>& igens = instrument->zones.getUnchecked(iz)->generators;
+                    for (int k = 0; k < igens.size(); k++)
+                    {
+                        if (igens.getUnchecked(k)->gen != Gen_SampleId)
+                            continue;
+                        
+                        // Stereo pairs are played together, so keep them adjacent
+                        const int index = igens.getUnchecked(k)->amount.uword;
+                        const Sample* s = _samples[index];
+                        const int pair[] = { index, s != nullptr && isStereo(s) ? s->sampleLink : -1 };
+                        for (int n = 0; n < 2; n++)
+                        {
+                            if (isPositiveAndBelow(pair[n], _samples.size()) && !placed[pair[n]])
+                            {
+                                placed.set(pair[n], true);
+                                order.add(pair[n]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    for (int i = 0; i < _samples.size(); i++)
+        if (!placed[i])
+            order.add(i);
+    
+    return order;
+}
+
+//---------------------------------------------------------
+//   selectPresets
+//---------------------------------------------------------
+
+int SoundFont::findPreset (int bank, int program) const
+{
+    for (int i = 0; i < _presets.size(); i++)
+        if (_presets.getUnchecked(i)->bank == bank && _presets.getUnchecked(i)->preset == program)
+            return i;
+    return -1;
+}
+
+bool SoundFont::selectPresets (const String& list)
+{
+    // Indices of samples change, which a running loader wouldn't expect
+    if (_loader != nullptr)
+    {
+        error("cannot select presets while loading");
+        return false;
+    }
+    
+    StringArray tokens;
+    tokens.addTokens(list, ", ", String());
+    tokens.removeEmptyStrings();
+    if (tokens.size() == 0)
+    {
+        error("no presets selected");
+        return false;
+    }
+    
+    Array<bool> keep;
+    keep.insertMultiple(0, false, _presets.size());
+    for (int t = 0; t < tokens.size(); t++)
+    {
+        // bank:program, or just the program of bank 0
+        const String& token = tokens[t];
+        const String bank = token.upToFirstOccurrenceOf(":", false, false);
+        const String program = token.fromFirstOccurrenceOf(":", false, false);
+        const bool hasBank = token.containsChar(':');
+        
+        if (!bank.containsOnly("0123456789") || bank.isEmpty()
+            || (hasBank && (!program.containsOnly("0123456789") || program.isEmpty())))
+        {
+            error("invalid preset " + token + ", expected bank:program");
+            return false;
+        }
+        
+        const int index = hasBank ? findPreset(bank.getIntValue(), program.getIntValue())
+                                  : findPreset(0, bank.getIntValue());
+        if (index < 0)
+        {
+            error("preset " + token + " not found");
+            return false;
+        }
+        keep.set(index, true);
+    }
+    
+    for (int i = _presets.size(); --i >= 0; )
+        if (!keep[i])
+            _presets.remove(i);
+    
+    // Also rebuilds the zone lists, which still hold zones of the presets removed
+    prune();
+    _indexFile = File();
+    log(String::formatted("Selected %d presets, %d instruments, %d samples",
+                          _presets.size(), _instruments.size(), _samples.size()));
+    return true;
+}
+
+//---------------------------------------------------------
+//   prune
+//---------------------------------------------------------
+
+/** New index of each element kept, -1 for those removed */
+static Array<int> renumber (const Array<bool>& used)
+{
+    Array<int> map;
+    int next = 0;
+    for (int i = 0; i < used.size(); i++)
+        map.add(used[i] ? next++ : -1);
+    return map;
+}
+
+/** Drops the entries of an array indexed like the samples, if it is */
+template <typename Type>
+static void removeUnmapped (Array<Type>& array, const Array<int>& map)
+{
+    if (array.size() != map.size())
+        return;
+    
+    Array<Type> kept;
+    for (int i = 0; i < map.size(); i++)
+        if (map.getUnchecked(i) >= 0)
+            kept.add(array.getReference(i));
+    array.swapWith(kept);
+}
+
+/** Follows presets to instruments and instruments to samples, removes all
+    that can't be reached, and renumbers Gen_Instrument, Gen_SampleId and
+    sample links. References out of range stay so, as the tables shrink. */
+bool SoundFont::prune (PruneSummary* summary)
+{
+    if (_loader != nullptr)
+    {
+        error("cannot prune while loading");
+        return false;
+    }
+    
+    Array<bool> usedInstruments, usedSamples;
+    usedInstruments.insertMultiple(0, false, _instruments.size());
+    usedSamples.insertMultiple(0, false, _samples.size());
+    
+    for (int p = 0; p < _presets.size(); p++)
+    {
+        const OwnedArray<Zone>& zones = _presets.getUnchecked(p)->zones;
+        for (int z = 0; z < zones.size(); z++)
+            for (int g = 0; g < zones.getUnchecked(z)->generators.size(); g++)
+            {
+                const GeneratorList* gen = zones.getUnchecked(z)->generators.getUnchecked(g);
+                if (gen->gen == Gen_Instrument && isPositiveAndBelow((int)gen->amount.uword, _instruments.size()))
+                    usedInstruments.set(gen->amount.uword, true);
+            }
+    }
+    
+    for (int i = 0; i < _instruments.size(); i++)
+    {
+        if (!usedInstruments[i])
+            continue;
+        
+        const OwnedArray<Zone>& zones = _instruments.getUnchecked(i)->zones;
+        for (int z = 0; z < zones.size(); z++)
+            for (int g = 0; g < zones.getUnchecked(z)->generators.size(); g++)
+            {
+                const GeneratorList* gen = zones.getUnchecked(z)->generators.getUnchecked(g);
+                if (gen->gen != Gen_SampleId || !isPositiveAndBelow((int)gen->amount.uword, _samples.size()))
+                    continue;
+                
+                // Stereo partners go together
+                const Sample* s = _samples.getUnchecked(gen->amount.uword);
+                usedSamples.set(gen->amount.uword, true);
+                if (isStereo(s) && isPositiveAndBelow(s->sampleLink, _samples.size()))
+                    usedSamples.set(s->sampleLink, true);
+            }
+    }
+    
+    const Array<int> instrumentMap = renumber(usedInstruments);
+    const Array<int> sampleMap = renumber(usedSamples);
+    
+    // References first, while the old indices are still valid
+    for (int p = 0; p < _presets.size(); p++)
+    {
+        const OwnedArray<Zone>& zones = _presets.getUnchecked(p)->zones;
+        for (int z = 0; z < zones.size(); z++)
+            for (int g = 0; g < zones.getUnchecked(z)->generators.size(); g++)
+            {
+                GeneratorList* gen = zones.getUnchecked(z)->generators.getUnchecked(g);
+                if (gen->gen == Gen_Instrument && isPositiveAndBelow((int)gen->amount.uword, _instruments.size()))
+                    gen->amount.uword = (ushort)instrumentMap.getUnchecked(gen->amount.uword);
+            }
+    }
+    
+    for (int i = 0; i < _instruments.size(); i++)
+    {
+        const OwnedArray<Zone>& zones = _instruments.getUnchecked(i)->zones;
+        for (int z = 0; z < zones.size(); z++)
+            for (int g = 0; g < zones.getUnchecked(z)->generators.size(); g++)
+            {
+                GeneratorList* gen = zones.getUnchecked(z)->generators.getUnchecked(g);
+                if (usedInstruments[i] && gen->gen == Gen_SampleId && isPositiveAndBelow((int)gen->amount.uword, _samples.size()))
+                    gen->amount.uword = (ushort)sampleMap.getUnchecked(gen->amount.uword);
+            }
+    }
+    
+    for (int i = 0; i < _samples.size(); i++)
+    {
+        Sample* s = _samples.getUnchecked(i);
+        if (!usedSamples[i] || !isPositiveAndBelow(s->sampleLink, _samples.size()))
+            continue;
+        
+        // A partner removed, or the meaningless link of a mono sample
+        s->sampleLink = sampleMap.getUnchecked(s->sampleLink);
+        if (s->sampleLink < 0)
+        {
+            s->sampleLink = 0;
+            if (isStereo(s))
+                s->sampletype = (s->sampletype & ~(Left | Right | Linked)) | Mono;
+        }
+    }
+    
+    PruneSummary removed;
+    for (int i = 0; i < _instruments.size(); i++)
+        if (!usedInstruments[i])
+            removed.names.add("instrument " + _instruments.getUnchecked(i)->name);
+    
+    for (int i = 0; i < _samples.size(); i++)
+        if (!usedSamples[i])
+            removed.names.add("sample " + _samples.getUnchecked(i)->name);
+    
+    for (int i = _instruments.size(); --i >= 0; )
+        if (!usedInstruments[i])
+        {
+            _instruments.remove(i);
+            removed.instruments++;
+        }
+    
+    for (int i = _samples.size(); --i >= 0; )
+        if (!usedSamples[i])
+        {
+            _samples.remove(i);
+            removed.samples++;
+        }
+    
+    if (summary != nullptr)
+        *summary = removed;
+    
+    if (removed.names.size() > 0)
+    {
+        log(String::formatted("Pruned %d unused instruments, %d unused samples", removed.instruments, removed.samples));
+        for (int i = 0; i < removed.names.size(); i++)
+            log("  " + removed.names[i]);
+    }
+    
+    removeUnmapped(_headersIn, sampleMap);
+    removeUnmapped(_sampleHashes, sampleMap);
+    removeUnmapped(_heads, sampleMap);
+    
+    // Zones of removed presets & instruments are gone with them. Also
+    // after selectPresets(), even if all instruments remain in use.
+    _pZones.clearQuick();
+    for (int p = 0; p < _presets.size(); p++)
+        for (int z = 0; z < _presets.getUnchecked(p)->zones.size(); z++)
+            _pZones.add(_presets.getUnchecked(p)->zones.getUnchecked(z));
+    
+    _iZones.clearQuick();
+    for (int i = 0; i < _instruments.size(); i++)
+        for (int z = 0; z < _instruments.getUnchecked(i)->zones.size(); z++)
+            _iZones.add(_instruments.getUnchecked(i)->zones.getUnchecked(z));
+    
+    MemoryStats::freed(MemoryStats::Metadata, _metadataSize);
+    _metadataSize = estimateMetadataSize();
+    MemoryStats::allocated(MemoryStats::Metadata, _metadataSize);
+    
+    // The index describes the file, which no longer matches
+    if (removed.instruments > 0 || removed.samples > 0)
+        _indexFile = File();
+    return true;
+}
+
 void SoundFont::dumpPresets()
 {
     int idx = 0;
@@ -1794,7 +2969,31 @@ void SoundFont::dumpPresets()
 
 void SoundFont::log (const String message)
 {
+    if (!_verbose)
+        return;
+    
+    const char* charp = message.getCharPointer();
+    fprintf (stderr, "%s\n", charp);
+}
+
+void SoundFont::error (const String message)
+{
+    {
+        const ScopedLock sl (_errorLock);
+        _lastError = message;
+    }
     const char* charp = message.getCharPointer();
     fprintf (stderr, "%s\n", charp);
 }
 
+String SoundFont::getLastError() const
+{
+    const ScopedLock sl (_errorLock);
+    return _lastError;
+}
+
+void SoundFont::setVerbose (bool verbose)
+{
+    _verbose = verbose;
+}
+
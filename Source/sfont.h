@@ -244,6 +244,19 @@ public:
 // Size in bytes for file positioning - critical
 #define SampleMetaSize 32
 
+/** Non-standard extension: Where a copy of the first frames of a sample is
+    stored, for players preloading all heads at once. See SampleLayout. */
+
+struct SampleHead
+{
+    SampleHead() : start(0), frames(0) {};
+    
+    uint start;     // in frames from the start of the smpl chunk, like Sample
+    uint frames;
+};
+
+#define SampleHeadSize 8
+
 /** Offsets start/end are absolute from start of chunk, measured in
     samples or bytes (depending on compression format). Loop points
     are absolute in the file (SF2 only), but turn into relative offsets 
@@ -260,10 +273,23 @@ public:
     
     SampleCompression getCompressionType();
     void setCompressionType (SampleCompression c);
+    static int withCompressionType (int sampletype, SampleCompression c);
+    void allocateSampleData (int numSamples);
+    void allocateByteData (int numBytes);
     void dropSampleData();
     void dropByteData();
     SampleMeta* createMeta();
-    bool checkMeta();
+    bool checkMeta() const;
+    bool isLoaded() const;
+    
+    /** Progress of sample data loading, see SoundFont::loadSample() */
+    enum LoadState
+    {
+        NotLoaded,
+        Loading,
+        Loaded,
+        LoadFailed
+    };
     
     String name;
     uint start;
@@ -284,11 +310,157 @@ public:
     
     ScopedPointer<SampleMeta> meta;
     
+    Atomic<int> loadState;
+    int storedBytes;      // size in the input file
+    double decodeSeconds; // time taken to load & decompress
+    
     JUCE_LEAK_DETECTOR (Sample);
 };
     
 
 
+//---------------------------------------------------------
+//   SampleLayout
+//---------------------------------------------------------
+
+/** How sample data is arranged in the smpl chunk of an output. Sample
+    headers keep their indices either way, only the offsets change. */
+
+struct SampleLayout
+{
+    SampleLayout() : alignment(0), byPreset(false), headFrames(0) {};
+    
+    /** Empty for the default layout, else e.g. "align 4096, by preset" */
+    String getDescription() const;
+    
+    int alignment;  // file offset multiple each sample starts at, 0 packs them
+    bool byPreset;  // samples of each preset together, presets by bank & program
+    
+    /** SF2 only: copies of the first frames of every sample go in front of
+        all sample data, located by a shdH chunk. Preloading all heads is
+        then one sequential read, while the samples stay whole. Players
+        skipping unknown chunks read the file as usual, but sf2convert
+        builds before shdH reject it. Compressed payloads can't be cut
+        without decoding, so SF3 & SF4 ignore this. */
+    int headFrames;
+};
+
+//---------------------------------------------------------
+//   Encoding
+//---------------------------------------------------------
+
+/** Compressed sample payloads for one output format. Samples may be
+    encoded ahead of time and concurrently, each by SoundFont::encodeSample(),
+    so that SoundFont::write() merely assembles the file. */
+
+class Encoding
+{
+public:
+    Encoding (FileType format, int quality, int numSamples);
+   ~Encoding();
+    
+    FileType format;
+    int quality;
+    SampleLayout layout;
+    OwnedArray<MemoryBlock> payloads; // indexed like samples, null until encoded
+    Array<double> seconds;            // encoding time per sample
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Encoding);
+};
+
+
+//---------------------------------------------------------
+//   CodecRegistry
+//---------------------------------------------------------
+
+/** The Vorbis & FLAC formats and their quality options, shared by all
+    SoundFonts. Created on first use rather than per font, and never
+    changed afterwards, so any thread may use it without locking. */
+
+class CodecRegistry
+{
+public:
+    static const CodecRegistry& getInstance();
+    
+    /** Null for SF2Format */
+    AudioFormat* getFormat (FileType format) const;
+    const StringArray& getQualityOptions (FileType format) const;
+    
+private:
+    CodecRegistry();
+    
+    ScopedPointer<AudioFormat> vorbis;
+    ScopedPointer<AudioFormat> flac;
+    StringArray vorbisOptions;
+    StringArray flacOptions;
+    StringArray none;
+    
+    JUCE_DECLARE_NON_COPYABLE (CodecRegistry);
+};
+
+//---------------------------------------------------------
+//   PruneSummary
+//---------------------------------------------------------
+
+/** What SoundFont::prune() removed */
+
+struct PruneSummary
+{
+    PruneSummary() : instruments(0), samples(0) {};
+    
+    int instruments;
+    int samples;
+    StringArray names;  // e.g. "instrument Strings 2", "sample Flute C4"
+};
+
+//---------------------------------------------------------
+//   Asynchronous loading
+//---------------------------------------------------------
+
+class SoundFont;
+
+/** Shared flag to abort SoundFont::readAsync(). The same token may
+    be handed to several fonts in order to cancel them all at once. */
+
+class CancellationToken : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<CancellationToken> Ptr;
+    
+    CancellationToken() : cancelled(0) {};
+    
+    void cancel()               { cancelled.set(1); }
+    bool isCancelled() const    { return cancelled.get() != 0; }
+    
+private:
+    Atomic<int> cancelled;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CancellationToken);
+};
+
+/** Receives notifications from SoundFont::readAsync(). All callbacks are
+    made on the loader thread, so post them to your UI thread as needed. */
+
+class LoadListener
+{
+public:
+    virtual ~LoadListener() {};
+    
+    /** Headers are parsed: presets, instruments and sample headers may
+        be browsed now, but sample data is not available yet. */
+    virtual void presetsAvailable (SoundFont*) {};
+    
+    /** Sample data at this index was decoded and may be used. */
+    virtual void sampleLoaded (SoundFont*, int /*sampleIndex*/) {};
+    
+    /** Progress ranges 0..1, based on bytes of sample data read. */
+    virtual void loadProgress (SoundFont*, double /*progress*/) {};
+    
+    /** Called exactly once at the end, also after failure or cancellation. */
+    virtual void loadFinished (SoundFont*, bool /*success*/) {};
+};
+
+
 //---------------------------------------------------------
 //   SoundFont
 //---------------------------------------------------------
@@ -306,13 +478,113 @@ public:
 #endif
     
     SoundFont (const File filename);
+    
+    /** Reads from a stream instead of a file, e.g. from memory. Takes ownership. */
+    SoundFont (InputStream* input);
    ~SoundFont ();
     
     bool read();
     bool write(const File filename, FileType format, int quality);
+    bool write(const File filename, Encoding& encoding);
+    
+    /** Writes to any stream that can seek back, e.g. a MemoryOutputStream */
+    bool write(OutputStream& out, Encoding& encoding, const String& name = String());
+    
+    /** Encodes one sample's payload ahead of writing, loading its sample
+        data first if needed. Different samples may be encoded concurrently. */
+    bool encodeSample (int index, Encoding& encoding);
+    
+    /** Name of the encoder setting a format & quality map to, e.g. "FLAC 8" */
+    String getEncoderSetting (FileType format, int quality) const;
+    
+    /** Index into getEncoderOptions() that a format & quality map to */
+    int getEncoderOption (FileType format, int quality) const;
+    
+    /** All settings the codec of a format offers, e.g. Vorbis bitrates */
+    StringArray getEncoderOptions (FileType format) const;
+
     void dumpPresets();
     void log(const String message);
     
+    /** Errors are always printed, other log messages only if verbose (default) */
+    void error(const String message);
+    String getLastError() const;
+    void setVerbose (bool verbose);
+    
+    /** Parses all headers, but does not load any sample data yet.
+        Samples are then loaded on demand with loadSample(). */
+    bool readHeaders();
+    
+    /** Reads headers from a sidecar index instead of parsing them, if the
+        index matches the font file. Otherwise the index is written after
+        parsing, and updated with decoded lengths & hashes once all samples
+        were loaded. Set before reading, see FontIndex. */
+    void setIndexFile (const File& index);
+    
+    /** Adds lengths & hashes to the index once all samples are loaded.
+        Called by read(), and by readAsync() when done. */
+    bool updateIndex();
+    
+    /** Head of a sample in a heads-first file, null if there is none */
+    const SampleHead* getSampleHead (int i) const;
+    
+    /** Range of the file holding all heads, to be read in one go. Returns
+        false if the file wasn't written heads-first. */
+    bool getHeadsRange (int64& position, int64& numBytes) const;
+    
+    /** Whether readHeaders() was served by the index */
+    bool isReadFromIndex() const            { return _readFromIndex; }
+    
+    /** Content hash of a sample's decoded data from the index, 0 if unknown */
+    uint64 getSampleHash (int i) const      { return _sampleHashes[i]; }
+    
+    /** Loads headers and then all samples on a background thread, so this
+        returns immediately. The listener must outlive the load. */
+    bool readAsync (LoadListener* listener, CancellationToken::Ptr token = nullptr);
+    void cancelRead();
+    bool waitForReadToFinish (int timeoutMs = -1);
+    double getReadProgress() const;
+    
+    /** Loads sample data, unless already loaded. Safe to call from any
+        thread while readAsync() is in progress. */
+    bool loadSample (int index);
+    
+    /** Blocks until sample data is available. If nobody is decoding this
+        sample yet, it is decoded right away on the calling thread. */
+    bool waitForSample (int index, int timeoutMs = -1);
+    bool isLoaded() const;
+    
+    const String& getName() const           { return _name; }
+    int getNumPresets() const               { return _presets.size(); }
+    const Preset* getPreset (int i) const   { return _presets[i]; }
+    int getNumInstruments() const           { return _instruments.size(); }
+    const Instrument* getInstrument (int i) const { return _instruments[i]; }
+    int getNumSamples() const               { return _samples.size(); }
+    const Sample* getSample (int i) const   { return _samples[i]; }
+    
+    /** Indices of all presets, sorted by bank & program */
+    Array<int> getPresetsByNumber() const;
+    
+    /** Indices of all samples, those of the first preset by bank & program
+        first, each right before its stereo partner. Unused samples last. */
+    Array<int> getSamplesByPreset() const;
+    
+    /** Index of the preset with this bank & program, -1 if there is none */
+    int findPreset (int bank, int program) const;
+    
+    /** Keeps only the presets listed as bank:program, e.g. "0:0, 0:25, 128:0",
+        and the instruments & samples they use. All else is dropped and the
+        references renumbered. Call after readHeaders() and before loading
+        samples, so only the samples kept are ever decoded. Fails on a
+        malformed list or a preset the font doesn't have. */
+    bool selectPresets (const String& list);
+    
+    /** Removes instruments no preset uses through Gen_Instrument, and
+        samples no instrument zone of those uses through Gen_SampleId or
+        as stereo partner, renumbering all references. Call before loading
+        samples, so the samples removed are never decoded. */
+    bool prune (PruneSummary* summary = nullptr);
+    
     
 private:
     
@@ -343,11 +615,15 @@ private:
      sample lengths & loops for later verification of a compressed file.
      */
     void readShdX (int size);
+    void readShdH (int size);
     
     int readSampleData (Sample* s);
     int readSampleDataRaw (Sample* s);
     int readSampleDataVorbis (Sample* s);
     int readSampleDataFlac (Sample* s);
+    int decodeByteData (Sample* s, FileType format);
+    void closeInput();
+    int64 estimateMetadataSize() const;
 
     void writeDword (int val);
     void writeWord (unsigned short int val);
@@ -363,21 +639,39 @@ private:
     void writeInstrument (int zoneIdx, const Instrument* instrument);
 
     void writeIfil();
-    void writeSmpl (int quality);
+    void writeSmpl (Encoding& encoding);
+    int64 alignSample (int64 position, int alignment);
     void writePhdr();
     void writeBag (const char* fourcc, Array<Zone*>* zones);
     void writeMod (const char* fourcc, const Array<Zone*>* zones);
     void writeGen (const char* fourcc, Array<Zone*>* zones);
     void writeInst();
     void writeShdr();
-    void writeShdrEach (const Sample* s);
+    
+    /** Sample header fields as written to the current output file. These
+        differ from the Sample in memory, which is never changed by writing. */
+    struct SampleHeader
+    {
+        SampleHeader() : start(0), end(0), loopstart(0), loopend(0), sampletype(0) {};
+        SampleHeader (const Sample* s, SampleCompression c);
+        
+        uint start;
+        uint end;
+        uint loopstart;
+        uint loopend;
+        int sampletype;
+    };
+    
+    void writeShdrEach (const Sample* s, const SampleHeader& h);
     
     void writeShdX();
+    void writeShdH();
     void writeShdXEach (const SampleMeta* m);
 
     int writeSampleDataPlain (Sample* s);
-    int writeSampleDataVorbis (Sample* s, int quality);
-    int writeSampleDataFlac (Sample* s, int quality);
+    int writeSampleDataEncoded (int index, Encoding& encoding);
+    int encodeSampleDataVorbis (const Sample* s, int option, MemoryBlock& output);
+    int encodeSampleDataFlac (const Sample* s, int option, MemoryBlock& output);
     
     bool writeCSample (Sample*, int idx);
     
@@ -407,22 +701,42 @@ private:
     
     int64 _samplePos;
     int64 _sampleLen;
+    int64 _metadataSize; // estimate, see MemoryStats
     
-    FileInputStream* _infile;   // should be a WeakReference, actually
-    FileOutputStream* _outfile; // should be a WeakReference, actually
+    ScopedPointer<InputStream> _infile; // kept open until all samples are loaded
+    OutputStream* _outfile; // only valid while writing
+    CriticalSection _writeLock; // one output file at a time
+    Array<SampleHeader> _headersOut;
+    Array<SampleHeader> _headersIn; // as in the input file, for the index
+    Array<SampleHead> _heads;       // of the input file, if heads-first
+    Array<SampleHead> _headsOut;    // as written to the current output file
+    CriticalSection _readLock;  // guards _infile while samples load on several threads
 
     FileType _fileFormatIn, _fileFormatOut;
     int64 _fileSizeIn, _fileSizeOut;
     
-    AudioFormatManager _manager;
-    OggVorbisAudioFormat* _audioFormatVorbis;
-    FlacAudioFormat* _audioFormatFlac;
-    StringArray _qualityOptionsVorbis;
-    StringArray _qualityOptionsFlac;
+    bool _verbose;
+    String _lastError;
+    CriticalSection _errorLock;
     
     Array<Zone*> _pZones; // owned by _presets after loading
     Array<Zone*> _iZones; // owned by _instruments after loading
     
+    File _indexFile;
+    bool _readFromIndex;
+    bool _indexComplete;
+    Array<uint64> _sampleHashes;
+    
+    class Loader;
+    friend class Loader;
+    friend class SyntheticBank;
+    friend class CodecAnalysis;
+    friend class FontIndex;
+    ScopedPointer<Loader> _loader;
+    CancellationToken::Ptr _cancel;
+    WaitableEvent _sampleEvent;
+    Atomic<int64> _bytesLoaded;
+    
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SoundFont);
 };
     
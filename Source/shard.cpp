@@ -0,0 +1,531 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shard.h"
+
+#if ! JUCE_WINDOWS
+#include <sys/wait.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+
+using namespace SF2;
+
+#if ! JUCE_WINDOWS
+
+//---------------------------------------------------------
+//   Worker
+//---------------------------------------------------------
+
+/** One worker process and the pipes to its stdin & stdout */
+
+class ShardedBatch::Worker
+{
+public:
+    Worker (const StringArray& args) : item(nullptr), deadline(0), arguments(args), pid(-1), input(-1), output(-1) {}
+   ~Worker() { stop(); }
+    
+    bool isRunning() const  { return pid > 0; }
+    int getOutput() const   { return output; }
+    
+    bool start()
+    {
+        int toChild[2], fromChild[2];
+        if (::pipe(toChild) != 0)
+            return false;
+        if (::pipe(fromChild) != 0)
+        {
+            ::close(toChild[0]);
+            ::close(toChild[1]);
+            return false;
+        }
+        
+        // Workers started later must not inherit these, or they would
+        // keep a pipe open after the process at its other end has died
+        for (int i = 0; i < 2; i++)
+        {
+            ::fcntl(toChild[i], F_SETFD, FD_CLOEXEC);
+            ::fcntl(fromChild[i], F_SETFD, FD_CLOEXEC);
+        }
+        
+        // Everything the child needs is prepared before the fork
+        HeapBlock<char*> argv (arguments.size() + 1);
+        for (int i = 0; i < arguments.size(); i++)
+            argv[i] = const_cast<char*>(arguments[i].toRawUTF8());
+        argv[arguments.size()] = nullptr;
+        
+        const pid_t child = ::fork();
+        if (child == 0)
+        {
+            ::dup2(toChild[0], STDIN_FILENO);
+            ::dup2(fromChild[1], STDOUT_FILENO);
+            ::execv(argv[0], argv);
+            
+            static const char message[] = "error\tcannot start worker process\n";
+            ssize_t ignored = ::write(STDOUT_FILENO, message, sizeof(message) - 1);
+            (void)ignored;
+            ::_exit(127);
+        }
+        
+        ::close(toChild[0]);
+        ::close(fromChild[1]);
+        
+        if (child < 0)
+        {
+            ::close(toChild[1]);
+            ::close(fromChild[0]);
+            return false;
+        }
+        
+        pid = child;
+        input = toChild[1];
+        output = fromChild[0];
+        buffer.reset();
+        return true;
+    }
+    
+    bool send (const String& request)
+    {
+        const String line = request + "\n";
+        const char* data = line.toRawUTF8();
+        size_t remaining = strlen(data);
+        
+        while (remaining > 0)
+        {
+            const ssize_t n = ::write(input, data, remaining);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            remaining -= (size_t)n;
+        }
+        return true;
+    }
+    
+    /** Adds complete response lines to lines. Returns false once the process is gone. */
+    bool receive (StringArray& lines)
+    {
+        char chunk[4096];
+        const ssize_t n = ::read(output, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR)
+            return true;
+        if (n <= 0)
+            return false;
+        
+        buffer.append(chunk, (size_t)n);
+        
+        for (;;)
+        {
+            const char* data = (const char*)buffer.getData();
+            const char* end = (const char*)memchr(data, '\n', buffer.getSize());
+            if (end == nullptr)
+                break;
+            
+            const size_t length = (size_t)(end - data);
+            lines.add(String::fromUTF8(data, (int)length));
+            buffer.removeSection(0, length + 1);
+        }
+        return true;
+    }
+    
+    /** Ends a worker that hangs, returns how it ended */
+    String kill()
+    {
+        if (pid > 0)
+            ::kill(pid, SIGKILL);
+        return stop();
+    }
+    
+    /** Closes the pipes, which ends an idle worker, and waits for the process.
+        Returns how it ended. */
+    String stop()
+    {
+        if (pid <= 0)
+            return String();
+        
+        ::close(input);
+        ::close(output);
+        input = output = -1;
+        
+        String reason ("ended");
+        int status = 0;
+        pid_t result;
+        while ((result = ::waitpid(pid, &status, 0)) < 0 && errno == EINTR)
+            ;
+        
+        if (result == pid)
+        {
+            if (WIFSIGNALED(status))
+                reason = "killed by signal " + String(WTERMSIG(status));
+            else if (WIFEXITED(status))
+                reason = "exited with code " + String(WEXITSTATUS(status));
+        }
+        pid = -1;
+        return reason;
+    }
+    
+    BatchItem* item; // being converted, if any
+    uint32 deadline; // for item, see Time::getMillisecondCounter()
+
+private:
+    const StringArray arguments;
+    pid_t pid;
+    int input;  // its stdin
+    int output; // its stdout
+    MemoryBlock buffer;
+    
+    JUCE_DECLARE_NON_COPYABLE (Worker);
+};
+
+#endif
+
+//---------------------------------------------------------
+//   ShardedBatch
+//---------------------------------------------------------
+
+ShardedBatch::ShardedBatch (BatchConverter& batch, int numProcesses, int threadsPerProcess) :
+    _batch(batch),
+    _numProcesses(jmax(1, numProcesses)),
+    _threadsPerProcess(jmax(1, threadsPerProcess)),
+    _verbose(false),
+    _maxRetries(1),
+    _timeout(1800),
+    _restarts(0),
+    _numDone(0)
+{
+}
+
+ShardedBatch::~ShardedBatch()
+{
+}
+
+bool ShardedBatch::isSupported()
+{
+#if JUCE_WINDOWS
+    return false;
+#else
+    return true;
+#endif
+}
+
+//---------------------------------------------------------
+//   run
+//---------------------------------------------------------
+
+int ShardedBatch::run()
+{
+#if JUCE_WINDOWS
+    fprintf(stderr, "Worker processes are not available on Windows, converting in this process\n");
+    return _batch.run(_numProcesses * _threadsPerProcess);
+#else
+    const double started = Time::getMillisecondCounterHiRes();
+    
+    // A worker dying must show up as a failed write, not kill the coordinator
+    signal(SIGPIPE, SIG_IGN);
+    
+    _batch.enqueueLargestFirst();
+    _pending = _batch._queue;
+    _crashes.clearQuick();
+    _crashes.insertMultiple(0, 0, _batch._items.size());
+    _quarantined.clearQuick();
+    _restarts = 0;
+    _numDone = 0;
+    
+    StringArray arguments;
+    arguments.add(File::getSpecialLocation(File::currentExecutableFile).getFullPathName());
+    arguments.add("--worker");
+    arguments.add("--jobs");
+    arguments.add(String(_threadsPerProcess));
+    if (_cacheDirectory != File())
+    {
+        arguments.add("--cache");
+        arguments.add(_cacheDirectory.getFullPathName());
+    }
+    if (_batch._layout.alignment > 0)
+    {
+        arguments.add("--align");
+        arguments.add(String(_batch._layout.alignment));
+    }
+    if (_batch._layout.byPreset)
+        arguments.add("--preset-order");
+    if (_batch._layout.headFrames > 0)
+    {
+        arguments.add("--heads");
+        arguments.add(String(_batch._layout.headFrames));
+    }
+    if (_batch._prune)
+        arguments.add("--prune");
+    if (_batch._index)
+        arguments.add("--index");
+    if (_verbose)
+        arguments.add("--verbose");
+    
+    OwnedArray<Worker> workers;
+    for (int i = 0; i < jmin(_numProcesses, _pending.size()); i++)
+        workers.add(new Worker(arguments));
+    
+    const int total = _pending.size();
+    while (_numDone < total)
+    {
+        // Idle workers get the next file, dead ones are restarted on demand
+        for (int w = 0; w < workers.size(); w++)
+        {
+            Worker* worker = workers.getUnchecked(w);
+            while (worker->item == nullptr && _pending.size() > 0)
+            {
+                BatchItem* item = _pending.removeAndReturn(0);
+                const String request = getRequest(item);
+                
+                if (request.isEmpty())
+                {
+                    item->error = "file name contains a tab or line break";
+                    done(item, "FAILED");
+                }
+                else if (!worker->isRunning() && !worker->start())
+                {
+                    item->error = "cannot start worker process: " + String(strerror(errno));
+                    done(item, "FAILED");
+                }
+                else
+                {
+                    // If this fails, the worker is gone and that shows below
+                    worker->item = item;
+                    worker->deadline = Time::getMillisecondCounter() + (uint32)_timeout * 1000;
+                    worker->send(request);
+                }
+            }
+        }
+        
+        Array<Worker*> busy;
+        HeapBlock<pollfd> fds (workers.size());
+        for (int w = 0; w < workers.size(); w++)
+        {
+            Worker* worker = workers.getUnchecked(w);
+            if (worker->item != nullptr)
+            {
+                fds[busy.size()].fd = worker->getOutput();
+                fds[busy.size()].events = POLLIN;
+                fds[busy.size()].revents = 0;
+                busy.add(worker);
+            }
+        }
+        
+        if (busy.size() == 0)
+            continue; // the rest failed without a worker
+        
+        // Until the first deadline
+        int wait = -1;
+        if (_timeout > 0)
+        {
+            const uint32 now = Time::getMillisecondCounter();
+            for (int b = 0; b < busy.size(); b++)
+            {
+                const int remaining = jmax(0, (int)(busy.getUnchecked(b)->deadline - now));
+                wait = wait < 0 ? remaining : jmin(wait, remaining);
+            }
+        }
+        
+        if (::poll(fds, (nfds_t)busy.size(), wait) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Waiting for worker processes failed: %s\n", strerror(errno));
+            break;
+        }
+        
+        for (int b = 0; b < busy.size(); b++)
+        {
+            Worker* worker = busy.getUnchecked(b);
+            
+            // Hanging, e.g. a decoder stuck in a loop
+            if (fds[b].revents == 0)
+            {
+                if (_timeout > 0 && (int)(Time::getMillisecondCounter() - worker->deadline) >= 0)
+                {
+                    worker->kill();
+                    _restarts++;
+                    
+                    BatchItem* item = worker->item;
+                    worker->item = nullptr;
+                    crashed(item, "timed out after " + String(_timeout) + " s");
+                }
+                continue;
+            }
+            
+            StringArray lines;
+            const bool alive = worker->receive(lines);
+            
+            // One response per request
+            for (int l = 0; l < lines.size() && worker->item != nullptr; l++)
+            {
+                complete(worker->item, lines[l]);
+                worker->item = nullptr;
+            }
+            
+            if (!alive)
+            {
+                const String reason = worker->stop();
+                _restarts++;
+                
+                if (worker->item != nullptr)
+                {
+                    BatchItem* item = worker->item;
+                    worker->item = nullptr;
+                    crashed(item, reason);
+                }
+            }
+        }
+    }
+    
+    // Closing their stdin ends the workers
+    workers.clear();
+    
+    _batch._seconds = (Time::getMillisecondCounterHiRes() - started) / 1000.0;
+    
+    int failed = 0;
+    for (int i = 0; i < _batch._items.size(); i++)
+        if (!_batch._items.getUnchecked(i)->ok)
+            failed++;
+    
+    return failed;
+#endif
+}
+
+//---------------------------------------------------------
+//   getRequest
+//---------------------------------------------------------
+
+/** Same as the server's convert request. Empty if a path would break the protocol. */
+String ShardedBatch::getRequest (const BatchItem* item) const
+{
+    StringArray paths;
+    paths.add(item->input.getFullPathName());
+    for (int o = 0; o < item->outputs.size(); o++)
+        paths.add(item->outputs.getUnchecked(o)->file.getFullPathName());
+    
+    for (int i = 0; i < paths.size(); i++)
+        if (paths[i].containsAnyOf("\t\r\n"))
+            return String();
+    
+    String request;
+    request << "convert\t" << paths[0];
+    
+    for (int o = 0; o < item->outputs.size(); o++)
+    {
+        const BatchOutput* out = item->outputs.getUnchecked(o);
+        request << "\t" << BatchConverter::getFileExtension(out->format) << ":" << out->quality << ":" << paths[o + 1];
+    }
+    return request;
+}
+
+//---------------------------------------------------------
+//   complete
+//---------------------------------------------------------
+
+void ShardedBatch::complete (BatchItem* item, const String& response)
+{
+    StringArray fields;
+    fields.addTokens(response, "\t", "");
+    
+    if (fields[0] != "ok")
+    {
+        item->error = response.fromFirstOccurrenceOf("\t", false, false);
+        if (item->error.isEmpty())
+            item->error = "unexpected response from worker: " + response;
+        done(item, "FAILED");
+        return;
+    }
+    
+    item->ok = true;
+    item->sizeOut = fields[2].getLargeIntValue();
+    item->seconds = fields[3].getDoubleValue();
+    
+    // Only the count is known, which is all the summary needs
+    const bool allCached = fields[4].getIntValue() == item->outputs.size();
+    for (int o = 0; o < item->outputs.size(); o++)
+    {
+        BatchOutput* out = item->outputs.getUnchecked(o);
+        out->size = out->file.getSize();
+        out->cached = allCached;
+    }
+    
+    done(item, allCached ? "CACHED" : "OK    ");
+}
+
+//---------------------------------------------------------
+//   crashed
+//---------------------------------------------------------
+
+void ShardedBatch::crashed (BatchItem* item, const String& reason)
+{
+    const int crashes = ++_crashes.getReference(_batch._items.indexOf(item));
+    fprintf(stderr, "Worker %s while converting %s\n", reason.toRawUTF8(), item->input.getFullPathName().toRawUTF8());
+    
+    if (crashes <= _maxRetries)
+    {
+        _pending.add(item);
+        return;
+    }
+    
+    item->ok = false;
+    item->error = "quarantined, worker " + reason + (crashes > 1 ? " on every attempt" : "");
+    
+    // Workers rename outputs into place when complete, so earlier outputs
+    // of this file are still good and stay
+    _quarantined.add(item);
+    done(item, "QUARANTINED");
+}
+
+//---------------------------------------------------------
+//   done
+//---------------------------------------------------------
+
+void ShardedBatch::done (const BatchItem* item, const char* status)
+{
+    const int numDone = ++_numDone;
+    if (_batch._items.size() > 1)
+        fprintf(stderr, "[%d/%d] %s %s\n", numDone, _batch._items.size(), status, item->input.getFullPathName().toRawUTF8());
+}
+
+//---------------------------------------------------------
+//   printSummary
+//---------------------------------------------------------
+
+void ShardedBatch::printSummary() const
+{
+    _batch.printSummary();
+    
+    fprintf(stderr, "\nWorker processes: %d x %d thread(s), %d restart(s)\n", _numProcesses, _threadsPerProcess, _restarts);
+    
+    if (_quarantined.size() > 0)
+    {
+        fprintf(stderr, "Quarantined after crashing workers:\n");
+        for (int i = 0; i < _quarantined.size(); i++)
+            fprintf(stderr, "  %s\n", _quarantined.getUnchecked(i)->input.getFullPathName().toRawUTF8());
+    }
+}
@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "batch.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   ShardedBatch
+//---------------------------------------------------------
+
+/** Runs a BatchConverter's files in separate worker processes, so a file
+    that crashes its converter takes down only one worker, not the batch.
+    
+    Each worker is this executable started with --worker, converting one
+    file at a time with its own threads, fed through a pipe with the
+    protocol of ConversionServer. Files are handed out largest first to
+    whichever worker is idle. A worker that dies is restarted, and its
+    file retried on a fresh worker. A file that keeps crashing workers is
+    quarantined: it fails, and is listed as such in the summary. A worker
+    that takes too long with a file is killed and counts as crashed. */
+
+class ShardedBatch
+{
+public:
+    ShardedBatch (BatchConverter& batch, int numProcesses, int threadsPerProcess);
+   ~ShardedBatch();
+    
+    /** Passed on to the workers */
+    void setCacheDirectory (const File& directory)  { _cacheDirectory = directory; }
+    void setVerbose (bool verbose)                  { _verbose = verbose; }
+    
+    /** Number of times a file is retried after crashing a worker (default 1) */
+    void setMaxRetries (int retries)                { _maxRetries = retries; }
+    
+    /** Seconds a worker may take for one file before it is killed (default
+        1800), or 0 to wait forever */
+    void setTimeout (int seconds)                   { _timeout = seconds; }
+    
+    /** Converts all files, returns the number that failed */
+    int run();
+    
+    int getNumQuarantined() const                   { return _quarantined.size(); }
+    int getNumRestarts() const                      { return _restarts; }
+    
+    void printSummary() const;
+    
+    static bool isSupported();
+
+private:
+    class Worker;
+    
+    String getRequest (const BatchItem* item) const;
+    void complete (BatchItem* item, const String& response);
+    void crashed (BatchItem* item, const String& reason);
+    void done (const BatchItem* item, const char* status);
+    
+    BatchConverter& _batch;
+    const int _numProcesses;
+    const int _threadsPerProcess;
+    File _cacheDirectory;
+    bool _verbose;
+    int _maxRetries;
+    int _timeout;
+    int _restarts;
+    int _numDone;
+    
+    Array<BatchItem*> _pending;
+    Array<int> _crashes; // per item of the batch
+    Array<BatchItem*> _quarantined;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ShardedBatch);
+};
+    
+} // namespace
+
+#endif
@@ -0,0 +1,425 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "watch.h"
+#include "batch.h"
+
+#include <signal.h>
+
+#if JUCE_LINUX
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+using namespace SF2;
+
+static const char* const patterns = "*.sf2;*.sf3;*.sf4";
+static const int waitInterval = 500; // ms between checks for settled files
+static const int pollInterval = 2000; // ms between scans without inotify
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt (int)
+{
+    interrupted = 1;
+}
+
+/** Changes whenever size or modification time do */
+static int64 getStamp (const File& file)
+{
+    return (file.getLastModificationTime().toMilliseconds() << 20) ^ file.getSize();
+}
+
+//---------------------------------------------------------
+//   WatchService
+//---------------------------------------------------------
+
+WatchService::WatchService (const File& inDir, const File& outDir, FileType format, int quality, int numThreads) :
+    _inDir(inDir),
+    _outDir(outDir),
+    _format(format),
+    _quality(quality),
+    _verbose(false),
+    _settleTime(2000),
+    _maxQueue(64),
+    _prune(false),
+    _index(false),
+    _notify(-1),
+    _lastPoll(0),
+    _scheduler(numThreads)
+{
+}
+
+WatchService::~WatchService()
+{
+#if JUCE_LINUX
+    if (_notify >= 0)
+        ::close(_notify);
+#endif
+}
+
+//---------------------------------------------------------
+//   start
+//---------------------------------------------------------
+
+bool WatchService::start()
+{
+    if (!_inDir.isDirectory())
+    {
+        fprintf(stderr, "Not a directory: %s\n", _inDir.getFullPathName().toRawUTF8());
+        return false;
+    }
+    
+    // Outputs would be picked up as changed inputs
+    if (_outDir == _inDir || _outDir.isAChildOf(_inDir))
+    {
+        fprintf(stderr, "The output directory must be outside of the watched directory\n");
+        return false;
+    }
+
+#if JUCE_LINUX
+    _notify = ::inotify_init1(IN_CLOEXEC);
+    if (_notify < 0)
+        fprintf(stderr, "inotify not available (%s), scanning for changes instead\n", strerror(errno));
+#endif
+    
+    // Everything counts as changed at first, whatever is up to date is skipped later
+    if (_notify >= 0)
+        scan(_inDir);
+    else
+        rescan();
+    _lastPoll = Time::getMillisecondCounter();
+    
+    int outdated = 0;
+    for (int i = 0; i < _pending.size(); i++)
+        if (isStale(_pending.getReference(i).file))
+            outdated++;
+    
+    signal(SIGINT, interrupt);
+    signal(SIGTERM, interrupt);
+    
+    fprintf(stderr, "Watching %s (%s), %d file(s) out of date\n",
+            _inDir.getFullPathName().toRawUTF8(), _notify >= 0 ? "inotify" : "scanning", outdated);
+    return true;
+}
+
+//---------------------------------------------------------
+//   run
+//---------------------------------------------------------
+
+void WatchService::run()
+{
+    while (!interrupted)
+    {
+        if (_notify >= 0)
+            readEvents(waitInterval);
+        else
+        {
+            Thread::sleep(waitInterval);
+            if (Time::getMillisecondCounter() - _lastPoll >= (uint32)pollInterval)
+            {
+                rescan();
+                _lastPoll = Time::getMillisecondCounter();
+            }
+        }
+        
+        convertSettled();
+    }
+    
+    fprintf(stderr, "Stopped watching %s\n", _inDir.getFullPathName().toRawUTF8());
+}
+
+//---------------------------------------------------------
+//   scan
+//---------------------------------------------------------
+
+/** Watches a directory and all below it, reporting all files in there.
+    The watch comes first, so nothing created in between goes unnoticed. */
+void WatchService::scan (const File& directory)
+{
+    addWatch(directory);
+    
+    Array<File> children;
+    directory.findChildFiles(children, File::findFilesAndDirectories, false);
+    
+    for (int i = 0; i < children.size(); i++)
+    {
+        const File& child = children.getReference(i);
+        if (child.isDirectory())
+            scan(child);
+        else if (isWatched(child))
+            changed(child);
+    }
+}
+
+void WatchService::addWatch (const File& directory)
+{
+#if JUCE_LINUX
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_CREATE;
+    const int wd = ::inotify_add_watch(_notify, directory.getFullPathName().toRawUTF8(), mask);
+    if (wd < 0)
+    {
+        fprintf(stderr, "Cannot watch %s: %s\n", directory.getFullPathName().toRawUTF8(), strerror(errno));
+        return;
+    }
+    
+    // Same directory again, e.g. after an overflow
+    const int index = _watches.indexOf(wd);
+    if (index >= 0)
+        _directories.set(index, directory);
+    else
+    {
+        _watches.add(wd);
+        _directories.add(directory);
+    }
+#else
+    ignoreUnused(directory);
+#endif
+}
+
+//---------------------------------------------------------
+//   readEvents
+//---------------------------------------------------------
+
+void WatchService::readEvents (int timeout)
+{
+#if JUCE_LINUX
+    pollfd fd;
+    fd.fd = _notify;
+    fd.events = POLLIN;
+    fd.revents = 0;
+    
+    if (::poll(&fd, 1, timeout) <= 0)
+        return;
+    
+    int64 storage[2048]; // aligned for inotify_event
+    const ssize_t n = ::read(_notify, storage, sizeof(storage));
+    if (n <= 0)
+        return;
+    
+    const char* bytes = (const char*)storage;
+    for (const char* p = bytes; p < bytes + n; )
+    {
+        const inotify_event* event = (const inotify_event*)p;
+        p += sizeof(inotify_event) + event->len;
+        
+        // Events were lost, so look at everything again
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            scan(_inDir);
+            continue;
+        }
+        
+        const int index = _watches.indexOf(event->wd);
+        if (index < 0)
+            continue;
+        
+        // The directory is gone
+        if (event->mask & IN_IGNORED)
+        {
+            _watches.remove(index);
+            _directories.remove(index);
+            continue;
+        }
+        
+        if (event->len == 0)
+            continue;
+        
+        const File file = _directories.getReference(index).getChildFile(String::fromUTF8(event->name));
+        if (event->mask & IN_ISDIR)
+        {
+            if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                scan(file);
+        }
+        else if (isWatched(file))
+            changed(file);
+    }
+#else
+    ignoreUnused(timeout);
+#endif
+}
+
+//---------------------------------------------------------
+//   rescan
+//---------------------------------------------------------
+
+/** Without notifications, files are compared with the previous scan */
+void WatchService::rescan()
+{
+    Array<File> files;
+    _inDir.findChildFiles(files, File::findFiles, true, patterns);
+    
+    Array<int64> stamps;
+    for (int i = 0; i < files.size(); i++)
+    {
+        const File& file = files.getReference(i);
+        const int64 stamp = getStamp(file);
+        const int index = _known.indexOf(file);
+        
+        if (index < 0 || _knownStamps[index] != stamp)
+            changed(file);
+        stamps.add(stamp);
+    }
+    
+    _known.swapWith(files);
+    _knownStamps.swapWith(stamps);
+}
+
+//---------------------------------------------------------
+//   changed
+//---------------------------------------------------------
+
+void WatchService::changed (const File& file)
+{
+    const uint32 now = Time::getMillisecondCounter();
+    
+    for (int i = 0; i < _pending.size(); i++)
+    {
+        Pending& p = _pending.getReference(i);
+        if (p.file == file)
+        {
+            p.lastChange = now;
+            return;
+        }
+    }
+    
+    Pending p;
+    p.file = file;
+    p.lastChange = now;
+    p.size = -1;
+    p.modified = 0;
+    _pending.add(p);
+    
+    if (_verbose)
+        fprintf(stderr, "Changed %s\n", file.getFullPathName().toRawUTF8());
+}
+
+bool WatchService::isWatched (const File& file) const
+{
+    return file.hasFileExtension("sf2;sf3;sf4");
+}
+
+/** Up to date if the input is as it was when converted. Copies often keep
+    the time of their source, so comparing times only does for outputs of
+    earlier runs, found at startup. */
+bool WatchService::isStale (const File& file) const
+{
+    const File output = getOutput(file);
+    if (!output.existsAsFile())
+        return true;
+    
+    const int index = _converted.indexOf(file);
+    if (index >= 0)
+        return _convertedStamps[index] != getStamp(file);
+    
+    return output.getLastModificationTime() < file.getLastModificationTime();
+}
+
+File WatchService::getOutput (const File& file) const
+{
+    return _outDir.getChildFile(file.getRelativePathFrom(_inDir)).withFileExtension(BatchConverter::getFileExtension(_format));
+}
+
+//---------------------------------------------------------
+//   convertSettled
+//---------------------------------------------------------
+
+void WatchService::convertSettled()
+{
+    const uint32 now = Time::getMillisecondCounter();
+    Array<File> ready;
+    
+    for (int i = 0; i < _pending.size() && ready.size() < _maxQueue; )
+    {
+        Pending& p = _pending.getReference(i);
+        
+        // Files growing slowly, e.g. copied over the network, may not
+        // raise an event for every write, so the file itself is checked
+        const int64 size = p.file.getSize();
+        const int64 modified = p.file.getLastModificationTime().toMilliseconds();
+        if (size != p.size || modified != p.modified)
+        {
+            p.size = size;
+            p.modified = modified;
+            p.lastChange = now;
+        }
+        
+        if (now - p.lastChange < (uint32)_settleTime)
+        {
+            i++;
+            continue;
+        }
+        
+        if (p.file.existsAsFile() && isStale(p.file))
+            ready.add(p.file);
+        _pending.remove(i);
+    }
+    
+    if (ready.size() == 0)
+        return;
+    
+    BatchConverter converter (_format, _quality);
+    converter.setVerbose(_verbose);
+    converter.setSampleLayout(_layout);
+    converter.setPruneEnabled(_prune);
+    converter.setIndexEnabled(_index);
+    if (_cacheDirectory != File())
+        converter.setCacheDirectory(_cacheDirectory);
+    
+    // Taken before converting, so a change meanwhile makes it stale again
+    Array<int64> stamps;
+    for (int i = 0; i < ready.size(); i++)
+    {
+        converter.addFile(ready.getReference(i), getOutput(ready.getReference(i)));
+        stamps.add(getStamp(ready.getReference(i)));
+    }
+    
+    const int failed = converter.run(_scheduler);
+    
+    for (int i = 0; i < converter.getNumItems(); i++)
+    {
+        const BatchItem* item = converter.getItem(i);
+        if (item->ok)
+        {
+            const int index = _converted.indexOf(item->input);
+            if (index >= 0)
+                _convertedStamps.set(index, stamps[i]);
+            else
+            {
+                _converted.add(item->input);
+                _convertedStamps.add(stamps[i]);
+            }
+        }
+        
+        if (!item->ok)
+            fprintf(stderr, "FAILED %s: %s\n", item->input.getFullPathName().toRawUTF8(), item->error.toRawUTF8());
+        else if (converter.getNumItems() == 1)
+            fprintf(stderr, "OK     %s\n", item->input.getFullPathName().toRawUTF8());
+    }
+    
+    fprintf(stderr, "Converted %d of %d changed file(s) in %.1f s\n",
+            converter.getNumItems() - failed, converter.getNumItems(), converter.getSeconds());
+}
@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  sf2convert
+//  SoundFont Conversion/Compression Utility
+//
+//  Copyright (C)
+//  2010 Werner Schweer and others (MuseScore)
+//  2015 Davy Triponney (Polyphone)
+//  2017 Cognitone (Juce port, converter)
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License version 2.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "sfont.h"
+#include "scheduler.h"
+
+namespace SF2 {
+
+//---------------------------------------------------------
+//   WatchService
+//---------------------------------------------------------
+
+/** Keeps a directory tree of SoundFonts converted, mirroring it into an
+    output directory like BatchConverter::addDirectory().
+    
+    Changes are picked up with inotify on Linux, elsewhere by scanning the
+    tree every few seconds. A changed file is converted once it has been
+    left alone for the settle time, so files still being written or copied
+    are not picked up half-way. Only files without an output, or with an
+    output older than themselves, are converted. Settled files are
+    converted together, at most a queue's worth per round, and outputs are
+    replaced atomically. Deleting an input leaves its output alone. */
+
+class WatchService
+{
+public:
+    WatchService (const File& inDir, const File& outDir, FileType format, int quality, int numThreads);
+   ~WatchService();
+    
+    void setCacheDirectory (const File& directory)  { _cacheDirectory = directory; }
+    void setVerbose (bool verbose)                  { _verbose = verbose; }
+    void setSampleLayout (const SampleLayout& layout)  { _layout = layout; }
+    void setPruneEnabled (bool enabled)             { _prune = enabled; }
+    void setIndexEnabled (bool enabled)             { _index = enabled; }
+    
+    /** Milliseconds a file must be left unchanged before it is converted (default 2000) */
+    void setSettleTime (int milliseconds)           { _settleTime = milliseconds; }
+    
+    /** Maximum number of files converted per round (default 64) */
+    void setMaxQueue (int numFiles)                 { _maxQueue = numFiles; }
+    
+    /** Starts watching and queues all files that are out of date */
+    bool start();
+    
+    /** Converts changes until interrupted by SIGINT or SIGTERM */
+    void run();
+    
+    bool isUsingNotifications() const               { return _notify >= 0; }
+
+private:
+    /** A file changed recently, waiting to settle */
+    struct Pending
+    {
+        File file;
+        uint32 lastChange;
+        int64 size;
+        int64 modified;
+    };
+    
+    void scan (const File& directory);
+    void addWatch (const File& directory);
+    void readEvents (int timeout);
+    void rescan();
+    void changed (const File& file);
+    bool isWatched (const File& file) const;
+    bool isStale (const File& file) const;
+    File getOutput (const File& file) const;
+    void convertSettled();
+    
+    const File _inDir;
+    const File _outDir;
+    const FileType _format;
+    const int _quality;
+    File _cacheDirectory;
+    bool _verbose;
+    int _settleTime;
+    int _maxQueue;
+    SampleLayout _layout;
+    bool _prune;
+    bool _index;
+    
+    int _notify;                // inotify descriptor, or -1 when polling
+    Array<int> _watches;        // inotify watch descriptors...
+    Array<File> _directories;   // ...and what they watch
+    
+    Array<File> _known;         // when polling: all files seen...
+    Array<int64> _knownStamps;  // ...and their size & time
+    
+    Array<File> _converted;         // inputs converted while watching...
+    Array<int64> _convertedStamps;  // ...and their size & time back then
+    uint32 _lastPoll;
+    
+    Array<Pending> _pending;
+    Scheduler _scheduler;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WatchService);
+};
+    
+} // namespace
+
+#endif